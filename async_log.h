@@ -0,0 +1,193 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "common.h"
+#include "lockfree_ring.h"
+
+enum class LogEvent : uint16_t {
+    SUBFRAME,       // server started a cell's subframe
+    REQUEST,        // server received a request
+    ALLOCATED,      // server allocated requests of one direction
+    AGGREGATING,    // client sends a subframe's requests
+    RESPONSE        // UE received its response
+};
+
+// Fixed-size binary log record, formatted later by the logger thread
+struct LogRecord {
+    static constexpr uint32_t NO_CELL = UINT32_MAX;  // single-cell runs do not print the cell
+    LogEvent event;
+    ResourceType direction;
+    AllocationStatus status;
+    uint16_t rb;
+    uint32_t cell;
+    uint32_t subframe;
+    uint32_t ue_id;
+    uint32_t count;         // data length, number of requests or allocations
+    uint32_t requested;     // requests of an ALLOCATED direction
+};
+
+inline void formatLogRecord(std::ostream& os, const LogRecord& rec) {
+    switch (rec.event) {
+    case LogEvent::SUBFRAME:
+        if (rec.cell != LogRecord::NO_CELL) os << "cell " << rec.cell << " ";
+        os << "subframe " << rec.subframe << "\n";
+        break;
+    case LogEvent::REQUEST:
+        os << "Request from " << rec.ue_id << " for " << rec.count << " blocks in " << rec.direction << "\n";
+        break;
+    case LogEvent::ALLOCATED:
+        os << (rec.direction == ResourceType::UL ? "UL" : "DL") << ": allocated " << rec.count << " of requested " << rec.requested << "\n";
+        break;
+    case LogEvent::AGGREGATING:
+        os << "Subframe " << rec.subframe;
+        if (rec.count) os << ": aggregating " << rec.count << " requests";
+        os << "\n";
+        break;
+    case LogEvent::RESPONSE:
+        os << "UE " << rec.ue_id << " received response with status " << rec.status;
+        if (rec.status == AllocationStatus::SUCCESS) {
+            os << " from subframe " << rec.subframe;
+            if (rec.rb != SchedulerResponse::NO_RB) os << " in block " << rec.rb;
+        }
+        os << "\n";
+        break;
+    }
+}
+
+/* Asynchronous logger: every thread writes LogRecords into its own SPSC ring
+ * (a thread-local lookup and a ring push, no formatting and no locks), a
+ * background thread formats the records and writes them to stdout. Records of
+ * one thread keep their order; when a ring is full the record is dropped and
+ * counted rather than blocking the hot path.
+ */
+class AsyncLog {
+    using Ring = SpscRing<LogRecord>;
+    static constexpr std::size_t RING_CAPACITY = 1024;
+    static constexpr auto IDLE_POLL = std::chrono::milliseconds(1);
+
+    std::mutex registry_mtx_{};
+    std::vector<std::shared_ptr<Ring>> rings_{};
+    std::mutex drain_mtx_{};                // one consumer of the rings at a time
+    std::thread formatter_{};
+    std::condition_variable stop_cv_{};
+    bool stop_ = false;
+    std::atomic<uint64_t> dropped_{0};
+
+    std::shared_ptr<Ring> registerThread() {
+        auto ring = std::make_shared<Ring>(RING_CAPACITY);
+        std::unique_lock guard(registry_mtx_);
+        rings_.push_back(ring);
+        if (!formatter_.joinable()) formatter_ = std::thread([this]() { run(); });
+        return ring;
+    }
+
+    Ring& localRing() {
+        thread_local std::shared_ptr<Ring> ring = registerThread();
+        return *ring;
+    }
+
+    // Formats and prints everything logged so far, returns the number of records
+    std::size_t drain() {
+        std::unique_lock drain_guard(drain_mtx_);
+        std::vector<std::shared_ptr<Ring>> rings;
+        {
+            std::unique_lock guard(registry_mtx_);
+            rings = rings_;
+        }
+        std::ostringstream out;
+        std::size_t drained = 0;
+        LogRecord rec;
+        for (auto& ring : rings) {
+            while (ring->tryPop(rec)) {
+                formatLogRecord(out, rec);
+                drained++;
+            }
+        }
+        const uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+        if (dropped) out << dropped << " log records dropped\n";
+        if (drained || dropped) std::cout << out.str() << std::flush;
+        pruneExited(rings);
+        return drained;
+    }
+
+    // Forgets rings of exited threads once their last records are drained, the next drain gets any pushed since
+    void pruneExited(std::vector<std::shared_ptr<Ring>>& snapshot) {
+        snapshot.clear();
+        std::unique_lock guard(registry_mtx_);
+        rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](const std::shared_ptr<Ring>& ring) {
+            if (ring.use_count() != 1) return false;
+            std::atomic_thread_fence(std::memory_order_acquire);   // pairs with the owner thread's release of the ring
+            return ring->empty();
+        }), rings_.end());
+    }
+
+    void run() {
+        std::unique_lock guard(registry_mtx_);
+        while (!stop_) {
+            guard.unlock();
+            const std::size_t drained = drain();
+            guard.lock();
+            if (!drained) stop_cv_.wait_for(guard, IDLE_POLL);
+        }
+    }
+
+  public:
+    AsyncLog() = default;
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator = (const AsyncLog&) = delete;
+
+    ~AsyncLog() {
+        {
+            std::unique_lock guard(registry_mtx_);
+            stop_ = true;
+        }
+        stop_cv_.notify_all();
+        if (formatter_.joinable()) formatter_.join();
+        drain();
+    }
+
+    void write(const LogRecord& rec) {
+        if (!localRing().tryPush(rec)) dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Prints records written so far by threads that are not writing concurrently
+    void flush() { drain(); }
+};
+
+inline AsyncLog async_log;
+
+inline void logSubframe(uint32_t cell, unsigned subframe) {
+    async_log.write({LogEvent::SUBFRAME, ResourceType::UL, AllocationStatus::SUCCESS, 0, cell, subframe, 0, 0, 0});
+}
+
+inline void logRequest(const ResourceRequest& req) {
+    async_log.write({LogEvent::REQUEST, req.resource_type, AllocationStatus::SUCCESS, 0, 0, 0, req.ue_id, req.data_length, 0});
+}
+
+inline void logAllocated(ResourceType direction, unsigned allocated, unsigned requested) {
+    async_log.write({LogEvent::ALLOCATED, direction, AllocationStatus::SUCCESS, 0, 0, 0, 0, allocated, requested});
+}
+
+inline void logAggregating(unsigned subframe, unsigned num_requests) {
+    async_log.write({LogEvent::AGGREGATING, ResourceType::UL, AllocationStatus::SUCCESS, 0, 0, subframe, 0, num_requests, 0});
+}
+
+inline void logResponse(const SchedulerResponse& resp) {
+    async_log.write({LogEvent::RESPONSE, ResourceType::UL, resp.status, resp.rb, 0, resp.subframe, resp.ue_id, 0, 0});
+}
@@ -0,0 +1,129 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "wire.h"
+
+/* Slots of FRAME_MTU bytes for a batch of frames moved with one recvmmsg or
+ * sendmmsg call. Received frames are read in place; frames to send are
+ * encoded into the slots by queue() and go out when all slots are used or
+ * on flush(). On a socket with SO_RXQ_OVFL set, receive() also picks up how
+ * many datagrams the socket has dropped.
+ */
+class CellDatagrams {
+    static constexpr std::size_t CONTROL_WORDS = (CMSG_SPACE(sizeof(uint32_t)) + 7) / 8;
+
+    std::vector<uint8_t> data_;
+    std::vector<struct sockaddr_in> addrs_;
+    std::vector<struct iovec> iov_;
+    std::vector<struct mmsghdr> msgs_;
+    std::vector<uint64_t> control_;
+    unsigned queued_ = 0;
+    uint64_t bytes_ = 0;
+    uint32_t socket_drops_ = 0;
+
+    void reset(unsigned i, std::size_t len) {
+        iov_[i] = {&data_[i * FRAME_MTU], len};
+        msgs_[i] = {};
+        msgs_[i].msg_hdr.msg_name = &addrs_[i];
+        msgs_[i].msg_hdr.msg_namelen = sizeof(addrs_[i]);
+        msgs_[i].msg_hdr.msg_iov = &iov_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+
+  public:
+    explicit CellDatagrams(unsigned slots)
+      : data_(slots * FRAME_MTU),
+        addrs_(slots),
+        iov_(slots),
+        msgs_(slots),
+        control_(slots * CONTROL_WORDS) {
+    }
+
+    unsigned slots() const { return msgs_.size(); }
+
+    // Payload bytes sent or received so far
+    uint64_t bytes() const { return bytes_; }
+
+    // Datagrams the socket dropped so far, as of the last one received
+    uint32_t socketDrops() const { return socket_drops_; }
+
+    /* Receives up to count datagrams into the first slots, returns how many
+     * arrived. flags as for recvmmsg, MSG_WAITFORONE returns as soon as one is
+     * there. Nothing arriving before a receive timeout or with MSG_DONTWAIT is
+     * not an error.
+     */
+    unsigned receive(int sockfd, unsigned count, int flags) {
+        for (unsigned i = 0; i < count; i++) {
+            reset(i, FRAME_MTU);
+            msgs_[i].msg_hdr.msg_control = &control_[i * CONTROL_WORDS];
+            msgs_[i].msg_hdr.msg_controllen = CONTROL_WORDS * sizeof(uint64_t);
+        }
+        const int received = recvmmsg(sockfd, msgs_.data(), count, flags, nullptr);
+        if (received < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "recvmmsg error " << errno << ": " << strerror(errno) << '\n';
+            }
+            return 0;
+        }
+        for (int i = 0; i < received; i++) {
+            bytes_ += msgs_[i].msg_len;
+            for (auto* cmsg = CMSG_FIRSTHDR(&msgs_[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&msgs_[i].msg_hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) std::memcpy(&socket_drops_, CMSG_DATA(cmsg), sizeof(uint32_t));
+            }
+        }
+        return received;
+    }
+
+    const uint8_t* data(unsigned i) const { return &data_[i * FRAME_MTU]; }
+    std::size_t length(unsigned i) const { return msgs_[i].msg_len; }
+    const struct sockaddr_in& address(unsigned i) const { return addrs_[i]; }
+
+    /* Encodes a cell's batch into as many frames as it needs, sending the
+     * queued frames whenever every slot is used. Returns the number of frames.
+     */
+    template <typename T>
+    unsigned queue(int sockfd, uint32_t cell_id, uint32_t subframe, Span<const T> batch, const struct sockaddr_in& to) {
+        unsigned frames = 0;
+        std::size_t next = 0;
+        do {
+            if (queued_ == slots()) flush(sockfd);
+            const std::size_t len = encodeFrame(cell_id, subframe, batch, next, &data_[queued_ * FRAME_MTU]);
+            addrs_[queued_] = to;
+            reset(queued_++, len);
+            frames++;
+        } while (next < batch.size());
+        return frames;
+    }
+
+    // Sends the queued frames
+    void flush(int sockfd) {
+        unsigned first = 0;
+        while (first < queued_) {
+            const int sent = sendmmsg(sockfd, &msgs_[first], queued_ - first, 0);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "sendmmsg error " << errno << ": " << strerror(errno) << '\n';
+                break;
+            }
+            for (unsigned i = first; i < first + sent; i++) bytes_ += msgs_[i].msg_len;
+            first += sent;
+        }
+        queued_ = 0;
+    }
+};
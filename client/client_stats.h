@@ -0,0 +1,85 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "../common.h"
+#include "ue_stats.h"
+
+/* Client side results of a run: success of the requests by direction, the
+ * blocks granted and the subframes between two successful requests of a UE.
+ */
+class ClientStats {
+    const Configuration& cfg_;
+    unsigned success_ul{}, success_dl{}, total_ul{}, total_dl{};
+    uint64_t success_ul_blocks{}, success_dl_blocks{};
+    UeDelayTable delays_;
+
+  public:
+    explicit ClientStats(const Configuration& cfg)
+      : cfg_(cfg), delays_(cfg.M * cfg.CELLS, starvationSf(cfg)) {
+    }
+
+    static unsigned starvationSf(const Configuration& cfg) { return cfg.STARVATION_SF ? cfg.STARVATION_SF : cfg.K; }
+
+    void update(unsigned sf, const std::vector<ResourceRequest>& aggregated_reqests,
+                const std::vector<SchedulerResponse>& scheduler_response) {
+        assert(scheduler_response.size() <= aggregated_reqests.size());
+        for (std::size_t i = 0; i < scheduler_response.size(); i++) {
+            const SchedulerResponse& resp = scheduler_response[i];
+            const ResourceRequest& req = aggregated_reqests[i];
+            assert(req.ue_id == resp.ue_id && resp.ue_id < delays_.size());
+            const bool is_ul = req.resource_type == ResourceType::UL;
+            if (is_ul) total_ul++; else total_dl++;
+            if (resp.status != AllocationStatus::SUCCESS) continue;
+            if (is_ul) success_ul++; else success_dl++;
+            if (is_ul) success_ul_blocks += req.data_length; else success_dl_blocks += req.data_length;
+            delays_.success(resp.ue_id, sf);
+        }
+    }
+
+    double successRate() const { return 100.0 * (success_ul + success_dl) / std::max(1U, total_ul + total_dl); }
+
+    /* Throughput calculation based on number of successful allocations, therefore it have to
+     * take into account subframes after simulation end. With short simulation period, throughput
+     * numbers will be lower than reported on server side. Throughput is per cell, in bytes/sec.
+     * Throughput calculation assumes 1000 sf/sec regardless of SF_TIME_SCALE value.
+     */
+    double ulThroughput() const { return 1000.0 * success_ul_blocks / (cfg_.SIMULATION_PERIOD_SF + cfg_.K - 1) / cfg_.CELLS; }
+    double dlThroughput() const { return 1000.0 * success_dl_blocks / (cfg_.SIMULATION_PERIOD_SF + cfg_.K - 1) / cfg_.CELLS; }
+
+    // Delays of the whole run, O(UEs)
+    DelaySummary delaySummary() const { return delays_.summary(cfg_.SIMULATION_PERIOD_SF); }
+
+    double avgDelay() const { return delaySummary().avgDelay(); }
+
+    void report() const {
+        const DelaySummary summary = delaySummary();
+        if (cfg_.CELLS > 1) std::cout << "\nCells: " << cfg_.CELLS;
+        std::cout << "\nSuccess rate: " << successRate() << "%\n";
+        std::cout << "Uplink throughput: " << ulThroughput() << " bytes/sec\n";
+        std::cout << "Downlink throughput: " << dlThroughput() << " bytes/sec\n";
+        const uint64_t num_unserved_ues = summary.unservedUes();
+        if (num_unserved_ues < summary.ues) {
+            std::cout << "Average delay: " << summary.avgDelay() << " ms\n";
+            std::cout << "Delay p50/p95/p99: " << summary.delays.quantile(0.5) << "/" << summary.delays.quantile(0.95)
+                      << "/" << summary.delays.quantile(0.99) << " ms, max " << summary.delays.max() << " ms\n";
+        }
+        std::cout << "Starvation over " << starvationSf(cfg_) << " subframes: " << summary.starved_delays << " delays, "
+                  << summary.starving_ues << " UEs at the end\n";
+        if (num_unserved_ues > 0) {
+            std::cerr << "Insufficient simulation time, increase SIMULATION_PERIOD_SF parameter\n";
+            std::cout << "Number of unserved UEs: " << num_unserved_ues << " (" << 100.0 * num_unserved_ues / summary.ues << " %)\n";
+        }
+    }
+};
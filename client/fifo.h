@@ -0,0 +1,65 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+
+// Mutex-protected queue, the UE channels used before lockfree_ring.h
+template<typename T>
+class Fifo {
+    std::queue<T> queue_{};
+    std::mutex mtx_{};
+    std::condition_variable cond_empty_{};
+    bool done_ = false;
+
+  public:
+    Fifo() = default;
+    Fifo(const Fifo&) {/*not really copyable*/};
+    Fifo& operator = (const Fifo&) = delete;
+
+    Fifo(Fifo&&) = default;
+    Fifo& operator = (Fifo&&) = default;
+    ~Fifo() {
+        done();
+    };
+
+    void push(const T& item) {
+        std::unique_lock guard(mtx_);
+	queue_.push(item);
+	cond_empty_.notify_one();
+    }
+
+    void push(T&& item) {
+        std::unique_lock guard(mtx_);
+        queue_.push(std::move(item));
+	cond_empty_.notify_one();
+    }
+
+    bool pop(T& item) {
+        std::unique_lock guard(mtx_);
+        cond_empty_.wait(guard, [&]() { return !queue_.empty() || done_; });
+        if(done_)
+            return false;
+        item = std::move(queue_.front());
+        queue_.pop();
+        return true;
+    }
+
+    std::size_t size() {
+        std::unique_lock guard(mtx_);
+        return queue_.size();
+    }
+
+    void done() {
+         std::unique_lock guard(mtx_);
+         done_ = true;
+         cond_empty_.notify_all();
+     }
+};
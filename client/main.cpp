@@ -14,123 +14,188 @@
 #include <chrono>
 
 #include "../common.h"
+#include "ue_traffic.h"
+#include "ue_engine.h"
+#include "../lockfree_ring.h"
+#include "../shm_transport.h"
+#include "../cell_datagrams.h"
+#include "../metrics.h"
+#include "../async_log.h"
+#include "pacer.h"
+#include "client_stats.h"
 
-template<typename T>
-class Fifo {
-    std::queue<T> queue_{};
-    std::mutex mtx_{};
-    std::condition_variable cond_empty_{};
-    bool done_ = false;
+// Hot path timings and events of the client, dumped at exit and on SIGUSR1
+struct ClientMetrics {
+    LatencyHistogram ue_latency{"UE req->resp"};     // from generating a request to receiving its response
+    LatencyHistogram exchange{"exchange"};           // aggregator round trip to the server
+    LatencyHistogram sf_lateness{"SF lateness"};     // aggregator wakeup past the subframe deadline
+    LatencyHistogram sf_jitter{"SF jitter"};         // change of lateness between subframes
+    LatencyHistogram ue_wake{"UE wake lateness"};    // UE thread wakeup past the end of its back-off
+    EventCounter unanswered{"unanswered batches"};   // cell batches without responses within RESPONSE_TIMEOUT
+    EventCounter late{"late batches"};               // responses of given-up batches completed in a later subframe
 
-  public:
-    Fifo() = default;
-    Fifo(const Fifo&) {/*not really copyable*/};
-    Fifo& operator = (const Fifo&) = delete;
-
-    Fifo(Fifo&&) = default;
-    Fifo& operator = (Fifo&&) = default;
-    ~Fifo() {
-        done();
-    };
-
-    void push(const T& item) {
-        std::unique_lock guard(mtx_);
-	queue_.push(item);
-	cond_empty_.notify_one();
-    }
-
-    void push(T&& item) {
-        std::unique_lock guard(mtx_);
-        queue_.push(std::move(item));
-	cond_empty_.notify_one();
-    }
-
-    bool pop(T& item) {
-        std::unique_lock guard(mtx_);
-        cond_empty_.wait(guard, [&]() { return !queue_.empty() || done_; });
-        if(done_)
-            return false;
-        item = std::move(queue_.front());
-        queue_.pop();
-        return true;
-    }
+    std::vector<const LatencyHistogram*> all() const { return {&ue_latency, &exchange, &sf_lateness, &sf_jitter, &ue_wake}; }
+    std::vector<const EventCounter*> counters() const { return {&unanswered, &late}; }
+};
 
-    std::size_t size() {
-        std::unique_lock guard(mtx_);
-        return queue_.size();
-    }
+inline ClientMetrics client_metrics;
 
-    void done() {
-         std::unique_lock guard(mtx_);
-         done_ = true;
-         cond_empty_.notify_all();
-     }
+// A response and the subframe in which the aggregator delivered it
+struct UeDelivery {
+    SchedulerResponse resp;
+    unsigned sf;
 };
 
 class UE {
-    uint16_t ue_id_;
-    Fifo<ResourceRequest>& uplink_;
-    std::vector<Fifo<SchedulerResponse>>& downlink_;
+    const Configuration& cfg_;
+    const SubframePacer& pacer_;
+    UeTraffic traffic_;
+    MpscRing<ResourceRequest>& uplink_;
+    std::vector<SpscChannel<UeDelivery>>& downlink_;
 
   public:
-    UE() = default;
-    UE(uint32_t id, Fifo<ResourceRequest>& uplink, std::vector<Fifo<SchedulerResponse>>& downlink)
-      : ue_id_(id), uplink_(uplink), downlink_(downlink) {
+    UE(const Configuration& cfg, const SubframePacer& pacer, uint32_t id, MpscRing<ResourceRequest>& uplink,
+       std::vector<SpscChannel<UeDelivery>>& downlink)
+      : cfg_(cfg), pacer_(pacer), traffic_(cfg, id), uplink_(uplink), downlink_(downlink) {
     }
 
     void operator()() {
-        std::random_device rd;
-        std::mt19937 rng(rd());
-        std::uniform_int_distribution<uint32_t> resource_type(0, 1);
         while(true) {
-            const auto dir = cfg.UE_MODE == UeMode::DL_ONLY ? ResourceType::DL
-                           : cfg.UE_MODE == UeMode::UL_ONLY ? ResourceType::UL
-                           : static_cast<ResourceType>(resource_type(rng));
-            const uint16_t L = cfg.L;
-            uplink_.push({ue_id_, dir, L});
+            const uint64_t requested = monotonicNs();
+            uplink_.push(traffic_.nextRequest(cfg_));
             // After generating a request, the UE waits for a response message
-            SchedulerResponse resp;
-            if(!downlink_.at(ue_id_).pop(resp))
+            UeDelivery delivery;
+            if(!downlink_.at(traffic_.id()).pop(delivery))
                 return;
-            assert(ue_id_ == resp.ue_id);
-            if (cfg.DEBUGPRINTS) {
-                std::ostringstream outstr;
-                outstr << "UE " << ue_id_ << " received response with status " << resp.status << "\n";
-                std::cout << outstr.str();
-            }
-            // After receiving the response, the UE first sleeps for L subframes
-            std::this_thread::sleep_for(L * cfg.SF_TIME_SCALE);
-            // If UE receives a success response, it continues generating the next request message
-            if(resp.status == AllocationStatus::SUCCESS) continue;
-            std::uniform_int_distribution<std::mt19937::result_type> unif_dist(1, L);
-            const unsigned sleep_on_busy = unif_dist(rng);
-            std::this_thread::sleep_for( sleep_on_busy * cfg.SF_TIME_SCALE);
+            client_metrics.ue_latency.recordSince(requested);
+            assert(traffic_.id() == delivery.resp.ue_id);
+            // The next request is due in subframe sf + idle + 1 as with UeEngine: wake up midway
+            // through subframe sf + idle, after the aggregator has collected that subframe's requests
+            const unsigned idle = traffic_.idleAfter(cfg_, delivery.resp);
+            client_metrics.ue_wake.record(sleepUntil(pacer_.deadline(delivery.sf + idle) + pacer_.periodNs() / 2));
         }
     }
 };
 
-int main() {
-    int sockfd;
+void printSubframe(const Configuration& cfg, unsigned sf, size_t num_requests) {
+    if (cfg.DEBUGPRINTS) logAggregating(sf, num_requests);
+}
 
-    if ( (sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ) {
-        perror("socket creation failed");
-        exit(EXIT_FAILURE);
+/* Client side of the UDP transport, same interface as ShmTransport. Requests
+ * are split per cell (cell = ue_id / M) and every cell's batch is sent in as
+ * many frames as it needs, numbered with the subframe from 0 like the server's
+ * cells. A new batch is only started while fewer than UDP_WINDOW request
+ * frames wait for their responses. When nothing arrives for RESPONSE_TIMEOUT
+ * (SO_RCVTIMEO of the socket) the batches still unanswered are given up and
+ * their requests fail; their responses are recognised as stale if they come.
+ */
+class UdpLink {
+    static constexpr unsigned UDP_WINDOW = 64;
+
+    const Configuration& cfg_;
+    int sockfd_;
+    struct sockaddr_in servaddr_;
+    CellDatagrams requests_;
+    CellDatagrams responses_;
+    std::vector<std::vector<ResourceRequest>> cell_requests_;
+    std::vector<BatchAssembler<SchedulerResponse>> cell_responses_;
+    std::vector<unsigned> cell_frames_;      // request frames of the cell's batch
+    std::vector<uint8_t> cell_done_;         // the cell's batch is answered or given up
+    std::vector<unsigned> cell_responded_;   // responses of the cell merged so far
+    uint32_t subframe_ = 0;
+
+  public:
+    UdpLink(const Configuration& cfg, int sockfd, const struct sockaddr_in& servaddr)
+      : cfg_(cfg),
+        sockfd_(sockfd),
+        servaddr_(servaddr),
+        requests_(UDP_WINDOW),
+        responses_(UDP_WINDOW),
+        cell_requests_(cfg.CELLS),
+        cell_responses_(cfg.CELLS),
+        cell_frames_(cfg.CELLS),
+        cell_done_(cfg.CELLS),
+        cell_responded_(cfg.CELLS) {
     }
 
-    struct sockaddr_in servaddr{};
-    servaddr.sin_family = AF_INET;
-    servaddr.sin_addr.s_addr = INADDR_ANY;
-    servaddr.sin_port = htons(PORT);
+    static constexpr std::chrono::milliseconds RESPONSE_TIMEOUT{200};
+
+    uint64_t bytesSent() const { return requests_.bytes(); }
+    uint64_t bytesReceived() const { return responses_.bytes(); }
+
+    // Sends the subframe's requests to the server and receives its responses
+    void exchange(const std::vector<ResourceRequest>& aggregated_reqests, std::vector<SchedulerResponse>& scheduler_response) {
+        for (auto& batch : cell_requests_) batch.clear();
+        for (auto req : aggregated_reqests) cell_requests_[req.ue_id / cfg_.M].push_back(req);
+
+        std::fill(cell_done_.begin(), cell_done_.end(), 0);
+        uint32_t next_cell = 0;
+        unsigned in_flight = 0;
+        unsigned answered = 0;
+        while (answered < cfg_.CELLS) {
+            while (next_cell < cfg_.CELLS && in_flight < UDP_WINDOW) {
+                const auto& batch = cell_requests_[next_cell];
+                cell_frames_[next_cell] = requests_.queue(sockfd_, next_cell, subframe_, Span<const ResourceRequest>{batch.data(), batch.size()}, servaddr_);
+                in_flight += cell_frames_[next_cell++];
+            }
+            requests_.flush(sockfd_);
+            const unsigned arrived = responses_.receive(sockfd_, responses_.slots(), MSG_WAITFORONE);
+            if (!arrived) {
+                for (uint32_t cell = 0; cell < next_cell; cell++) {
+                    if (cell_done_[cell]) continue;
+                    cell_done_[cell] = 1;
+                    in_flight -= cell_frames_[cell];
+                    answered++;
+                    client_metrics.unanswered.add();
+                }
+            }
+            for (unsigned i = 0; i < arrived; i++) {
+                FrameHeader header;
+                if (!parseFrame(responses_.data(i), responses_.length(i), FrameKind::RESPONSES, header) || header.cell_id >= next_cell) {
+                    std::cerr << "received " << responses_.length(i) << " bytes, not a response frame\n";
+                    continue;
+                }
+                const Reassembly result = cell_responses_[header.cell_id].add(header, responses_.data(i), responses_.length(i));
+                if (result == Reassembly::MALFORMED) std::cerr << "Malformed frame for cell " << header.cell_id << "\n";
+                if (result != Reassembly::COMPLETE) continue;
+                if (header.subframe != subframe_) {
+                    client_metrics.late.add();
+                    continue;
+                }
+                if (cell_done_[header.cell_id]) continue;
+                cell_done_[header.cell_id] = 1;
+                in_flight -= cell_frames_[header.cell_id];
+                answered++;
+            }
+        }
 
-    Fifo<ResourceRequest> uplink_channel;
-    std::vector<Fifo<SchedulerResponse>> downlink_channels;
-    for(unsigned i = 0; i < cfg.M; i++) {
-        downlink_channels.emplace_back();
+        // Responses of each cell are in the order of its requests
+        std::fill(cell_responded_.begin(), cell_responded_.end(), 0);
+        scheduler_response.clear();
+        for (auto req : aggregated_reqests) {
+            const uint32_t cell = req.ue_id / cfg_.M;
+            const auto& responses = cell_responses_[cell];
+            if (responses.nextSubframe() > subframe_ && cell_responded_[cell] < responses.records().size()) {
+                scheduler_response.push_back(responses.records()[cell_responded_[cell]++]);
+            } else {
+                scheduler_response.push_back({req.ue_id, AllocationStatus::FAIL, SchedulerResponse::NO_RB, 0});
+            }
+        }
+        subframe_++;
     }
+};
+
+// Every UE runs in its own thread, subframes are paced by wall-clock time
+template <typename Link>
+void runUeThreads(const Configuration& cfg, Link& link, ClientStats& stats, SubframePacer& pacer) {
+    // A UE has at most one request in flight, so neither ring can overflow
+    const unsigned num_ues = cfg.M * cfg.CELLS;
+    MpscRing<ResourceRequest> uplink_channel(num_ues);
+    std::vector<SpscChannel<UeDelivery>> downlink_channels(num_ues);
 
     std::vector<UE> connected_ues;
-    for(unsigned i = 0; i < cfg.M; i++) {
-        connected_ues.emplace_back(i, uplink_channel, downlink_channels);
+    for(unsigned i = 0; i < num_ues; i++) {
+        connected_ues.emplace_back(cfg, pacer, i, uplink_channel, downlink_channels);
     }
 
     std::vector<std::thread> ueThreads;
@@ -138,58 +203,25 @@ int main() {
         ueThreads.emplace_back(ue);
     }
 
-    unsigned success_ul{}, success_dl{}, total_ul{}, total_dl{};
-    std::vector<unsigned> last_success_sf(cfg.M);
-    std::vector<double> avg_success_times(cfg.M);
-    std::vector<unsigned> success_count(cfg.M);
-
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<ResourceRequest> aggregated_reqests;
+    std::vector<SchedulerResponse> scheduler_response;
+    pacer.start();
     for(unsigned i = 1; i <= cfg.SIMULATION_PERIOD_SF; ++i) {
-        std::this_thread::sleep_for(cfg.SF_TIME_SCALE);
-        const size_t num_requests = uplink_channel.size();
-        if (cfg.DEBUGPRINTS) {
-            std::ostringstream outstr;
-            outstr << "Subframe " << i;
-            if (num_requests) outstr << ": aggregating " << num_requests << " requests";
-            outstr << "\n";
-            std::cout << outstr.str();
-        }
-        std::vector<ResourceRequest> aggregated_reqests(num_requests);
-        for (auto& req : aggregated_reqests) {
-            if (!uplink_channel.pop(req)) {
-                std::cout << "interrupted" << std::endl;
-                break;
-            }
-        }
+        pacer.waitFor(i);
+        aggregated_reqests.clear();
+        uplink_channel.drain(aggregated_reqests);
+        printSubframe(cfg, i, aggregated_reqests.size());
 
-        socklen_t len = sizeof(servaddr);
-        SockSend(sockfd, servaddr, len, aggregated_reqests);
-        if (aggregated_reqests.empty()) continue;
-
-        std::vector<SchedulerResponse> scheduler_response;
-        SockRecv(sockfd, servaddr, len, scheduler_response);
+        const uint64_t exchange_start = monotonicNs();
+        link.exchange(aggregated_reqests, scheduler_response);
+        client_metrics.exchange.recordSince(exchange_start);
 
         for (auto resp : scheduler_response) {
-            downlink_channels.at(resp.ue_id).push(resp);
+            downlink_channels.at(resp.ue_id).tryPush({resp, i});
         }
         // collect statistics after dispatch
-        unsigned resp_num = 0;
-        for (auto resp : scheduler_response) {
-            assert(aggregated_reqests.at(resp_num).ue_id == resp.ue_id);
-            const bool is_ul = aggregated_reqests.at(resp_num).resource_type == ResourceType::UL;
-            resp_num++;
-            if (is_ul) total_ul++; else total_dl++;
-            if (resp.status != AllocationStatus::SUCCESS) continue;
-            if (is_ul) success_ul++; else success_dl++;
-            if (last_success_sf.at(resp.ue_id) != 0) {
-                avg_success_times.at(resp.ue_id) += (i - last_success_sf.at(resp.ue_id));
-                success_count.at(resp.ue_id) += 1;
-            }
-            last_success_sf.at(resp.ue_id) = i;
-        }
+        stats.update(i, aggregated_reqests, scheduler_response);
     }
-    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-    std::cout << "\nSimulation time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "ms" << std::endl;
 
     for(auto& ch : downlink_channels) {
         ch.done();
@@ -197,34 +229,97 @@ int main() {
     for(auto& t : ueThreads) {
         t.join();
     }
-    close(sockfd);
+}
+
+// UEs are driven by UeEngine, paced by wall-clock time unless VIRTUAL_TIME is set
+template <typename Link>
+void runUeEngine(const Configuration& cfg, Link& link, ClientStats& stats, SubframePacer& pacer) {
+    UeEngine engine(cfg, cfg.M * cfg.CELLS, cfg.UE_WORKERS);
+
+    std::vector<ResourceRequest> aggregated_reqests;
+    std::vector<SchedulerResponse> scheduler_response;
+    pacer.start();
+    for(unsigned i = 1; i <= cfg.SIMULATION_PERIOD_SF; ++i) {
+        if (!cfg.VIRTUAL_TIME) pacer.waitFor(i);
+        // requests are made in collect() and reach their UEs in deliver()
+        const uint64_t collect_start = monotonicNs();
+        engine.collect(i, aggregated_reqests);
+        printSubframe(cfg, i, aggregated_reqests.size());
+
+        const uint64_t exchange_start = monotonicNs();
+        link.exchange(aggregated_reqests, scheduler_response);
+        client_metrics.exchange.recordSince(exchange_start);
 
-    const double success_rate = 100.0 * (success_ul + success_dl) / (total_ul + total_dl);
-    /* Throughput calculation based on number of successful allocations, therefore it have to
-     * take into account subframes after simulation end. With short simulation period, throughput
-     * numbers will be lower than reported on server side.
-     */
-    const double ul_blk_per_sf = 1.0 * success_ul * cfg.L / (cfg.SIMULATION_PERIOD_SF + cfg.K - 1);
-    const double dl_blk_per_sf = 1.0 * success_dl * cfg.L / (cfg.SIMULATION_PERIOD_SF + cfg.K - 1);
-    std::cout << "\nSuccess rate: " << success_rate << "%\n";
-    // Throughput calculation assumes 1000 sf/sec regardless of SF_TIME_SCALE value.
-    std::cout << "Uplink throughput: " << 1000.0 * ul_blk_per_sf << " bytes/sec\n";
-    std::cout << "Downlink throughput: " << 1000.0 * dl_blk_per_sf << " bytes/sec\n";
-
-    std::vector<double> nz_avg_success_times;
-
-    for(unsigned t = 0; t < avg_success_times.size(); t++) {
-        if (success_count.at(t) > 0) nz_avg_success_times.push_back(avg_success_times.at(t) / success_count.at(t));
+        engine.deliver(i, scheduler_response);
+        client_metrics.ue_latency.record(monotonicNs() - collect_start, scheduler_response.size());
+        stats.update(i, aggregated_reqests, scheduler_response);
     }
+}
 
-    if (nz_avg_success_times.size() > 0) {
-        const double avg_delay = std::accumulate(nz_avg_success_times.cbegin(), nz_avg_success_times.cend(), 0.0) / nz_avg_success_times.size();
-        std::cout << "Average delay: " << avg_delay << " ms\n";
+template <typename Link>
+void runUes(const Configuration& cfg, Link& link, ClientStats& stats) {
+    SubframePacer pacer(cfg.SF_TIME_SCALE, cfg.PACING_SPIN, client_metrics.sf_lateness, client_metrics.sf_jitter);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    if (cfg.UE_ENGINE == UeEngineType::THREADS && !cfg.VIRTUAL_TIME) {
+        runUeThreads(cfg, link, stats, pacer);
+    } else {
+        runUeEngine(cfg, link, stats, pacer);
     }
-    const unsigned num_unserved_ues = avg_success_times.size() - nz_avg_success_times.size();
-    if (num_unserved_ues > 0) {
-        std::cerr << "Insufficient simulation time, increase SIMULATION_PERIOD_SF parameter\n";
-        std::cout << "Number of unserved UEs: " << num_unserved_ues << " (" << 100.0 * num_unserved_ues / avg_success_times.size() << " %)\n";
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    async_log.flush();
+    std::cout << "\nSimulation time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "ms" << std::endl;
+    if (!cfg.VIRTUAL_TIME) std::cout << "Missed subframe deadlines: " << pacer.missed() << std::endl;
+}
+
+int main() {
+    dumpMetricsOnSignal(client_metrics.all(), client_metrics.counters());
+    const Configuration cfg = Configuration::load();
+    ClientStats stats(cfg);
+    if (cfg.TRANSPORT == TransportType::SHM) {
+        if (cfg.CELLS != 1) {
+            std::cerr << "SHM transport supports a single cell\n";
+            exit(EXIT_FAILURE);
+        }
+        try {
+            ShmTransport link(ShmRole::CLIENT, cfg.M);
+            runUes(cfg, link, stats);
+        } catch (const std::exception& e) {
+            std::cerr << "shared memory transport failed: " << e.what() << '\n';
+            exit(EXIT_FAILURE);
+        }
+        stats.report();
+        dumpMetrics(std::cout, client_metrics.all(), client_metrics.counters());
+        exit(EXIT_SUCCESS);
+    }
+
+    int sockfd;
+
+    if ( (sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ) {
+        perror("socket creation failed");
+        exit(EXIT_FAILURE);
     }
+
+    const auto timeout_us = std::chrono::microseconds(UdpLink::RESPONSE_TIMEOUT).count();
+    struct timeval timeout{};
+    timeout.tv_sec = timeout_us / 1000000;
+    timeout.tv_usec = timeout_us % 1000000;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        perror("SO_RCVTIMEO");
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_in servaddr{};
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = INADDR_ANY;
+    servaddr.sin_port = htons(PORT);
+
+    UdpLink link(cfg, sockfd, servaddr);
+    runUes(cfg, link, stats);
+    close(sockfd);
+
+    stats.report();
+    std::cout << "UDP payload per subframe: " << link.bytesSent() / cfg.SIMULATION_PERIOD_SF << " bytes sent, "
+              << link.bytesReceived() / cfg.SIMULATION_PERIOD_SF << " bytes received\n";
+    dumpMetrics(std::cout, client_metrics.all(), client_metrics.counters());
     exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,74 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+
+#include <time.h>
+
+#include "../metrics.h"
+
+/* Sleeps until deadline_ns, a monotonicNs() value. The last spin_ns are
+ * busy-waited, which trades a core for waking within a microsecond instead of
+ * the scheduler's wakeup latency. Returns how late the caller woke up.
+ */
+inline uint64_t sleepUntil(uint64_t deadline_ns, uint64_t spin_ns = 0) {
+    if (deadline_ns > spin_ns) {
+        const uint64_t wake_ns = deadline_ns - spin_ns;
+        const struct timespec wake{static_cast<time_t>(wake_ns / 1000000000), static_cast<long>(wake_ns % 1000000000)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR) {}
+    }
+    uint64_t now = monotonicNs();
+    while (now < deadline_ns) now = monotonicNs();
+    return now - deadline_ns;
+}
+
+/* Paces subframes against absolute deadlines: subframe sf starts at
+ * start() + sf * period, so oversleeping one subframe does not delay the
+ * following ones. Records how late every subframe started and how much that
+ * changed from the previous one; a subframe whose deadline had already passed
+ * when waitFor() was called counts as missed and starts without sleeping.
+ */
+class SubframePacer {
+    uint64_t period_ns_;
+    uint64_t spin_ns_;
+    LatencyHistogram& lateness_;
+    LatencyHistogram& jitter_;
+    uint64_t epoch_ns_ = 0;
+    uint64_t prev_lateness_ = 0;
+    uint64_t missed_ = 0;
+
+  public:
+    SubframePacer(std::chrono::nanoseconds period, std::chrono::nanoseconds spin, LatencyHistogram& lateness, LatencyHistogram& jitter)
+      : period_ns_(period.count()), spin_ns_(spin.count()), lateness_(lateness), jitter_(jitter) {
+    }
+
+    SubframePacer(const SubframePacer&) = delete;
+    SubframePacer& operator = (const SubframePacer&) = delete;
+
+    // Subframe 0 starts now
+    void start() { epoch_ns_ = monotonicNs(); }
+
+    // monotonicNs() at the start of subframe sf
+    uint64_t deadline(unsigned sf) const { return epoch_ns_ + sf * period_ns_; }
+    uint64_t periodNs() const { return period_ns_; }
+
+    // Waits for the start of subframe sf
+    void waitFor(unsigned sf) {
+        const uint64_t deadline = this->deadline(sf);
+        if (monotonicNs() > deadline) missed_++;
+        const uint64_t lateness = sleepUntil(deadline, spin_ns_);
+        lateness_.record(lateness);
+        jitter_.record(lateness > prev_lateness_ ? lateness - prev_lateness_ : prev_lateness_ - lateness);
+        prev_lateness_ = lateness;
+    }
+
+    uint64_t missed() const { return missed_; }
+};
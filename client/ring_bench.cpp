@@ -0,0 +1,115 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+
+/* Compares the mutex Fifo with the lock-free rings on the client's traffic
+ * pattern: many UE threads pushing into one uplink drained by the aggregator,
+ * and one aggregator thread feeding a UE's downlink.
+ */
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <future>
+#include <vector>
+
+#include "fifo.h"
+#include "../lockfree_ring.h"
+
+namespace {
+
+constexpr unsigned TOTAL_ITEMS = 1000000;
+
+using Clock = std::chrono::steady_clock;
+
+void report(const char* name, unsigned threads, Clock::duration elapsed) {
+    const double sec = std::chrono::duration<double>(elapsed).count();
+    std::cout << std::left << std::setw(10) << name << std::right << std::setw(8) << threads
+              << std::setw(12) << std::fixed << std::setprecision(2) << TOTAL_ITEMS / sec / 1e6 << " Mitems/s\n";
+}
+
+/* Runs producers pushing TOTAL_ITEMS in total, drain() takes whatever is queued.
+ * Thread start-up is kept out of the measurement.
+ */
+template <typename Push, typename Drain>
+Clock::duration contend(unsigned producers, Push push, Drain drain) {
+    const unsigned per_producer = TOTAL_ITEMS / producers;
+    const unsigned total = per_producer * producers;
+    std::promise<void> start;
+    std::shared_future<void> started = start.get_future().share();
+    std::vector<std::thread> threads;
+    for (unsigned p = 0; p < producers; p++) {
+        threads.emplace_back([&push, started, p, per_producer]() {
+            started.wait();
+            for (unsigned i = 0; i < per_producer; i++) push(p);
+        });
+    }
+    const auto begin = Clock::now();
+    start.set_value();
+    for (unsigned received = 0; received < total; ) {
+        const unsigned drained = drain();
+        if (!drained) std::this_thread::yield();
+        received += drained;
+    }
+    const auto elapsed = Clock::now() - begin;
+    for (auto& t : threads) t.join();
+    return elapsed;
+}
+
+void benchUplink(unsigned producers) {
+    {
+        Fifo<unsigned> fifo;
+        std::vector<unsigned> batch;
+        report("Fifo", producers, contend(producers, [&fifo](unsigned p) { fifo.push(p); }, [&fifo, &batch]() {
+            // the aggregator's former loop: size() then pop() each item
+            batch.resize(fifo.size());
+            for (auto& item : batch) fifo.pop(item);
+            return static_cast<unsigned>(batch.size());
+        }));
+    }
+    {
+        MpscRing<unsigned> ring(1 << 16);
+        std::vector<unsigned> batch;
+        report("MpscRing", producers, contend(producers, [&ring](unsigned p) { ring.push(p); }, [&ring, &batch]() {
+            batch.clear();
+            return static_cast<unsigned>(ring.drain(batch));
+        }));
+    }
+}
+
+// One producer, one blocking consumer
+template <typename Channel, typename Push>
+void benchDownlink(const char* name, Channel& channel, Push push) {
+    const auto begin = Clock::now();
+    std::thread consumer([&channel]() {
+        unsigned item;
+        for (unsigned i = 0; i < TOTAL_ITEMS; i++) channel.pop(item);
+    });
+    for (unsigned i = 0; i < TOTAL_ITEMS; i++) push(i);
+    consumer.join();
+    report(name, 2, Clock::now() - begin);
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "Uplink, N producers -> 1 draining consumer\n";
+    for (unsigned producers : {16U, 1000U, 10000U}) benchUplink(producers);
+
+    std::cout << "\nDownlink, 1 producer -> 1 blocking consumer\n";
+    {
+        Fifo<unsigned> fifo;
+        benchDownlink("Fifo", fifo, [&fifo](unsigned i) { fifo.push(i); });
+    }
+    {
+        SpscChannel<unsigned> channel(1024);
+        benchDownlink("SpscChan", channel, [&channel](unsigned i) {
+            while (!channel.tryPush(i)) std::this_thread::yield();
+        });
+    }
+    return 0;
+}
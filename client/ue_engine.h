@@ -0,0 +1,156 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ue_traffic.h"
+#include "../common.h"
+
+/* UE state machines (request -> await response -> idle L -> back-off) driven
+ * by a fixed pool of workers instead of a thread per UE. UEs are split into
+ * one shard per worker; a shard keeps its UEs in a timer wheel with one bucket
+ * per subframe, so a UE costs its UeTraffic (16 bytes) plus a wheel entry.
+ *
+ * Each subframe the aggregator hands the previous responses over with
+ * deliver() and gathers due requests with collect(): every worker files its
+ * shard's responses back into the wheel and emits the requests of the current
+ * bucket. A request made after idling d subframes from a response in subframe
+ * i is due in subframe i + d + 1, as it would be with UE threads. Requests of
+ * one subframe are shuffled, like racing UE threads, and do not depend on the
+ * number of workers.
+ */
+class UeEngine {
+    struct Shard {
+        uint32_t first_ue = 0;
+        std::vector<UeTraffic> ues{};
+        std::vector<std::vector<uint32_t>> wheel{};       // UE indices by due subframe
+        std::vector<SchedulerResponse> inbox{};
+        std::vector<ResourceRequest> outbox{};
+    };
+
+    const Configuration& cfg_;
+    uint32_t ues_per_shard_;
+    unsigned wheel_mask_;
+    unsigned responses_sf_ = 0;                           // subframe of the responses in the inboxes
+    unsigned current_sf_ = 0;
+    std::vector<Shard> shards_;
+    SplitMix64 arrival_rng_;
+
+    std::vector<std::thread> workers_{};
+    std::mutex mtx_{};
+    std::condition_variable start_cv_{};
+    std::condition_variable done_cv_{};
+    unsigned generation_ = 0;
+    unsigned pending_ = 0;
+    bool stop_ = false;
+
+    void step(Shard& shard) {
+        for (const auto& resp : shard.inbox) {
+            const uint32_t ue = resp.ue_id - shard.first_ue;
+            const unsigned due = responses_sf_ + shard.ues[ue].idleAfter(cfg_, resp) + 1;
+            shard.wheel[due & wheel_mask_].push_back(ue);
+        }
+        shard.inbox.clear();
+        auto& bucket = shard.wheel[current_sf_ & wheel_mask_];
+        shard.outbox.clear();
+        for (const uint32_t ue : bucket) {
+            shard.outbox.push_back(shard.ues[ue].nextRequest(cfg_));
+        }
+        bucket.clear();
+    }
+
+    void work(unsigned shard) {
+        unsigned seen = 0;
+        while (true) {
+            {
+                std::unique_lock guard(mtx_);
+                start_cv_.wait(guard, [&]() { return generation_ != seen || stop_; });
+                if (stop_) return;
+                seen = generation_;
+            }
+            step(shards_[shard]);
+            std::unique_lock guard(mtx_);
+            if (--pending_ == 0) done_cv_.notify_one();
+        }
+    }
+
+  public:
+    UeEngine(const Configuration& cfg, uint32_t num_ues, unsigned workers)
+      : cfg_(cfg),
+        ues_per_shard_(std::max(1U, (num_ues + std::max(workers, 1U) - 1) / std::max(workers, 1U))),
+        wheel_mask_(0),
+        shards_((num_ues + ues_per_shard_ - 1) / ues_per_shard_),
+        arrival_rng_(runSeed(cfg)) {
+        // longest idle time is L plus a back-off of up to L
+        const unsigned max_due = 2 * std::max(cfg.L, cfg.SHORT_L) + 1;
+        unsigned wheel_size = 1;
+        while (wheel_size <= max_due) wheel_size <<= 1;
+        wheel_mask_ = wheel_size - 1;
+        for (uint32_t i = 0; i < shards_.size(); i++) {
+            Shard& shard = shards_[i];
+            shard.first_ue = i * ues_per_shard_;
+            shard.wheel.resize(wheel_size);
+            for (uint32_t ue = i * ues_per_shard_; ue < std::min(num_ues, (i + 1) * ues_per_shard_); ue++) {
+                shard.ues.emplace_back(cfg, ue);
+                shard.wheel[1].push_back(ue - i * ues_per_shard_);  // every UE requests in the first subframe
+            }
+        }
+        if (workers > 1) {
+            for (unsigned i = 0; i < shards_.size(); i++) {
+                workers_.emplace_back(&UeEngine::work, this, i);
+            }
+        }
+    }
+
+    UeEngine(const UeEngine&) = delete;
+    UeEngine& operator = (const UeEngine&) = delete;
+
+    ~UeEngine() {
+        {
+            std::unique_lock guard(mtx_);
+            stop_ = true;
+            start_cv_.notify_all();
+        }
+        for (auto& t : workers_) {
+            t.join();
+        }
+    }
+
+    // Hands over the responses to the requests aggregated in subframe sf
+    void deliver(unsigned sf, const std::vector<SchedulerResponse>& responses) {
+        responses_sf_ = sf;
+        for (const auto& resp : responses) {
+            shards_[resp.ue_id / ues_per_shard_].inbox.push_back(resp);
+        }
+    }
+
+    // Gathers the requests due in subframe sf
+    void collect(unsigned sf, std::vector<ResourceRequest>& requests) {
+        current_sf_ = sf;
+        if (workers_.empty()) {
+            for (auto& shard : shards_) step(shard);
+        } else {
+            std::unique_lock guard(mtx_);
+            pending_ = workers_.size();
+            generation_++;
+            start_cv_.notify_all();
+            done_cv_.wait(guard, [&]() { return pending_ == 0; });
+        }
+        requests.clear();
+        for (const auto& shard : shards_) {
+            requests.insert(requests.end(), shard.outbox.cbegin(), shard.outbox.cend());
+        }
+        // same arrival order whatever the number of shards
+        std::sort(requests.begin(), requests.end(), [](const auto& a, const auto& b) { return a.ue_id < b.ue_id; });
+        std::shuffle(requests.begin(), requests.end(), arrival_rng_);
+    }
+};
@@ -0,0 +1,131 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "../metrics.h"
+
+/* Histogram of delays in subframes with the buckets of LatencyHistogram.
+ * Its size is fixed and merging adds the counts, so the sketches of worker
+ * threads or of separate runs combine without losing anything.
+ */
+class DelaySketch {
+    using Buckets = LogLinearBuckets;
+
+    std::array<uint64_t, Buckets::NUM_BUCKETS> counts_{};
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+
+  public:
+    void record(uint64_t delay) {
+        counts_[Buckets::bucketOf(delay)]++;
+        total_++;
+        max_ = std::max(max_, delay);
+    }
+
+    void merge(const DelaySketch& other) {
+        for (unsigned bucket = 0; bucket < Buckets::NUM_BUCKETS; bucket++) counts_[bucket] += other.counts_[bucket];
+        total_ += other.total_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+
+    // Upper bound of the q-quantile, 0 if nothing was recorded
+    uint64_t quantile(double q) const {
+        if (!total_) return 0;
+        const uint64_t rank = std::max<uint64_t>(1, q * total_ + 0.5);
+        uint64_t seen = 0;
+        for (unsigned bucket = 0; bucket < Buckets::NUM_BUCKETS; bucket++) {
+            seen += counts_[bucket];
+            if (seen >= rank) return std::min(Buckets::bucketUpper(bucket), max_);
+        }
+        return max_;
+    }
+};
+
+// Delays between successful requests of a set of UEs, summaries of disjoint sets or runs merge
+struct DelaySummary {
+    DelaySketch delays{};           // every delay between two successes of a UE
+    uint64_t ues = 0;
+    uint64_t served_ues = 0;        // UEs with at least two successes
+    double mean_delay_sum = 0;      // of the served UEs' mean delays
+    uint64_t starved_delays = 0;    // delays longer than the starvation threshold
+    uint64_t starving_ues = 0;      // UEs without a success for longer than the threshold at the end
+
+    void merge(const DelaySummary& other) {
+        delays.merge(other.delays);
+        ues += other.ues;
+        served_ues += other.served_ues;
+        mean_delay_sum += other.mean_delay_sum;
+        starved_delays += other.starved_delays;
+        starving_ues += other.starving_ues;
+    }
+
+    // Average over served UEs of their mean delay, 0 if no UE was served twice
+    double avgDelay() const { return served_ues ? mean_delay_sum / served_ues : 0; }
+
+    // UEs with less than two successful requests
+    uint64_t unservedUes() const { return ues - served_ues; }
+};
+
+/* Per-UE state for the delays between successful requests, one array per
+ * field: 12 bytes a UE whatever the length of the run. Delays go into the
+ * sketch as they happen, per-UE means are only folded in by summary().
+ * Subframes are numbered from 1, a last success in subframe 0 means none yet.
+ */
+class UeDelayTable {
+    std::vector<uint32_t> first_success_sf_;
+    std::vector<uint32_t> last_success_sf_;
+    std::vector<uint32_t> successes_;
+    unsigned starvation_sf_;
+    DelaySketch delays_{};
+    uint64_t starved_delays_ = 0;
+
+  public:
+    UeDelayTable(unsigned num_ues, unsigned starvation_sf)
+      : first_success_sf_(num_ues), last_success_sf_(num_ues), successes_(num_ues), starvation_sf_(starvation_sf) {
+    }
+
+    unsigned size() const { return successes_.size(); }
+
+    // A request of ue < size() succeeded in subframe sf
+    void success(uint32_t ue, unsigned sf) {
+        const uint32_t last = last_success_sf_[ue];
+        if (last != 0) {
+            const uint32_t delay = sf - last;
+            delays_.record(delay);
+            starved_delays_ += delay > starvation_sf_;
+        } else {
+            first_success_sf_[ue] = sf;
+        }
+        last_success_sf_[ue] = sf;
+        successes_[ue]++;
+    }
+
+    // Summary as of the end of subframe end_sf
+    DelaySummary summary(unsigned end_sf) const {
+        DelaySummary summary;
+        summary.delays = delays_;
+        summary.ues = size();
+        summary.starved_delays = starved_delays_;
+        for (unsigned ue = 0; ue < size(); ue++) {
+            if (successes_[ue] > 1) {
+                summary.mean_delay_sum += static_cast<double>(last_success_sf_[ue] - first_success_sf_[ue]) / (successes_[ue] - 1);
+                summary.served_ues++;
+            }
+            summary.starving_ues += end_sf - last_success_sf_[ue] > starvation_sf_;
+        }
+        return summary;
+    }
+};
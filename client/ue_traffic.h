@@ -0,0 +1,76 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <iostream>
+#include <random>
+#include <cstdint>
+
+#include "../common.h"
+#include "../async_log.h"
+
+// 64-bit state generator, small enough to keep one per UE
+class SplitMix64 {
+    uint64_t state_;
+
+  public:
+    using result_type = uint64_t;
+    explicit SplitMix64(uint64_t seed) : state_(seed) {}
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~result_type{0}; }
+
+    result_type operator()() {
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+};
+
+// Seed shared by all generators of the run: cfg.SEED, or random (once per process) if it is 0
+inline uint64_t runSeed(const Configuration& cfg) {
+    static const uint64_t random_seed = uint64_t{std::random_device{}()} << 32 | std::random_device{}();
+    return cfg.SEED ? cfg.SEED : random_seed;
+}
+
+/* Request pattern of one UE: what it asks for and how long it stays idle after
+ * a response. The run's Configuration is passed to every call rather than
+ * stored, so that a UE stays 16 bytes.
+ */
+class UeTraffic {
+    SplitMix64 rng_;
+    uint32_t ue_id_;
+    uint16_t data_length_ = 0;  // length of the outstanding request
+
+  public:
+    UeTraffic(const Configuration& cfg, uint32_t ue_id)
+      : rng_(runSeed(cfg) ^ (uint64_t{ue_id} << 32)), ue_id_(ue_id) {
+    }
+
+    uint32_t id() const { return ue_id_; }
+
+    ResourceRequest nextRequest(const Configuration& cfg) {
+        std::uniform_int_distribution<uint32_t> resource_type(0, 1);
+        std::uniform_int_distribution<uint32_t> percent(0, 99);
+        const auto dir = cfg.UE_MODE == UeMode::DL_ONLY ? ResourceType::DL
+                       : cfg.UE_MODE == UeMode::UL_ONLY ? ResourceType::UL
+                       : static_cast<ResourceType>(resource_type(rng_));
+        data_length_ = percent(rng_) < cfg.SHORT_SHARE ? cfg.SHORT_L : cfg.L;
+        return {ue_id_, dir, data_length_};
+    }
+
+    // Subframes to stay idle after the response to the outstanding request
+    unsigned idleAfter(const Configuration& cfg, const SchedulerResponse& resp) {
+        if (cfg.DEBUGPRINTS) logResponse(resp);
+        // After receiving the response, the UE first sleeps for L subframes
+        // If UE receives a success response, it continues generating the next request message
+        if(resp.status == AllocationStatus::SUCCESS) return data_length_;
+        std::uniform_int_distribution<unsigned> unif_dist(1, data_length_);
+        const unsigned sleep_on_busy = unif_dist(rng_);
+        return data_length_ + sleep_on_busy;
+    }
+};
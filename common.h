@@ -7,6 +7,7 @@
  */
 #pragma once
 
+#include <cmath>
 #include <cstring>
 #include <exception>
 #include <fstream>
@@ -29,12 +30,55 @@ enum class UeMode {
     MIXED
 };
 
+enum class TransportType {
+    UDP,        // datagram per subframe batch over loopback
+    SHM         // batches exchanged in a shared-memory ring, see shm_transport.h
+};
+
+enum class UeEngineType {
+    THREADS,    // one thread per UE
+    POOL        // UE state machines driven by a fixed pool of workers
+};
+
+enum class SchedulerEngine {
+    LINEAR,     // per-subframe counters, linear first-fit scan
+    INDEXED,    // per-subframe counters indexed by a segment tree
+    BITMAP      // per-resource-block grid, reports the allocated block
+};
+
+enum class PackingPolicy : unsigned {
+    FIRST_FIT,
+    BEST_FIT,
+    LONGEST_FIRST
+};
+
+inline std::ostream& operator << (std::ostream& os, const PackingPolicy& obj) {
+    os << (obj == PackingPolicy::FIRST_FIT ? "FIRST_FIT"
+         : obj == PackingPolicy::BEST_FIT ? "BEST_FIT" : "LONGEST_FIRST");
+    return os;
+}
+
+// Order in which the requests of a batch compete for the window, see server/policy.h
+enum class SchedulingPolicy : unsigned {
+    FIFO,               // arrival order
+    ROUND_ROBIN,        // UE waiting longest since its last grant first
+    PROPORTIONAL_FAIR,  // request length over the UE's average throughput
+    MAX_THROUGHPUT      // longest request first
+};
+
+inline std::ostream& operator << (std::ostream& os, const SchedulingPolicy& obj) {
+    os << (obj == SchedulingPolicy::FIFO ? "FIFO"
+         : obj == SchedulingPolicy::ROUND_ROBIN ? "ROUND_ROBIN"
+         : obj == SchedulingPolicy::PROPORTIONAL_FAIR ? "PROPORTIONAL_FAIR" : "MAX_THROUGHPUT");
+    return os;
+}
+
 enum class ResourceType : uint16_t {
     UL = 0,
     DL
 };
 
-std::ostream& operator << (std::ostream& os, const ResourceType& obj) {
+inline std::ostream& operator << (std::ostream& os, const ResourceType& obj) {
     os << (obj == ResourceType::UL ? "UPLINK" : "DOWNLINK");
     return os;
 }
@@ -44,44 +88,74 @@ enum class AllocationStatus : uint16_t {
     FAIL
 };
 
-std::ostream& operator << (std::ostream& os, const AllocationStatus& obj) {
+inline std::ostream& operator << (std::ostream& os, const AllocationStatus& obj) {
     os << (obj == AllocationStatus::SUCCESS ? "SUCCESS" : "FAIL");
     return os;
 }
 
 struct ResourceRequest {
-    uint16_t ue_id;
+    uint32_t ue_id;
     ResourceType resource_type;
     uint16_t data_length;
 };
 
 struct SchedulerResponse {
-    uint16_t ue_id;
+    static constexpr uint16_t NO_RB = 0xFFFF;  // scheduler engine does not assign blocks
+    uint32_t ue_id;
     AllocationStatus status;
+    uint16_t rb;        // resource block of the allocation
+    uint32_t subframe;  // first subframe of the allocation
+};
+
+// Non-owning view of a contiguous batch of records
+template <typename T>
+class Span {
+    T* data_;
+    std::size_t size_;
+
+  public:
+    Span(T* data, std::size_t size) : data_(data), size_(size) {}
+    T* begin() const { return data_; }
+    T* end() const { return data_ + size_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T& operator [] (std::size_t i) const { return data_[i]; }
 };
 
 struct Configuration {
     bool DEBUGPRINTS = true;
-    std::chrono::milliseconds SF_TIME_SCALE = std::chrono::milliseconds(1U); // Subframe duration, milliseconds (wall-clock time delay in simulation)
+    bool VIRTUAL_TIME = false; // advance subframes as fast as they are scheduled instead of SF_TIME_SCALE
+    unsigned SEED = 0; // seed of UE random generators, 0 seeds from std::random_device
+    TransportType TRANSPORT = TransportType::UDP;
+    std::string TRACE_RECORD{}; // server records request batches into this trace file, empty records nothing
+    std::chrono::nanoseconds SF_TIME_SCALE = std::chrono::milliseconds(1U); // Subframe duration, configured in fractional milliseconds (wall-clock time delay in simulation)
+    std::chrono::nanoseconds PACING_SPIN = std::chrono::nanoseconds(0U); // busy-waited tail of every subframe sleep, configured in microseconds
 
     unsigned SIMULATION_PERIOD_SF = 200;
     UeMode UE_MODE = UeMode::MIXED;
-    unsigned K{}; // maximum advance scheduling time
     unsigned L = 16; // data length
-    unsigned M = 16; // number of UEs to simulate
+    unsigned K = 10 * L; // maximum advance scheduling time, 10 * L unless set
+    unsigned STARVATION_SF = 0; // a UE starves when it goes longer than this without a successful request, 0 uses K
+    unsigned SHORT_L = 4; // data length of short (VoIP-like) requests
+    unsigned SHORT_SHARE = 0; // percentage of requests that are short, 0 sends L only
+    unsigned M = 16; // number of UEs to simulate per cell
+    unsigned CELLS = 1; // number of cells (eNBs), each with M UEs and its own schedulers
+    bool PIPELINE = false; // run receive, UL, DL and respond of a shard as pipeline stages on their own cores
+    unsigned SHARDS = 1; // server workers, each pinned to a core and owning every SHARDS-th cell, 0 uses all cores
+    UeEngineType UE_ENGINE = UeEngineType::THREADS;
+    unsigned UE_WORKERS = 4; // worker threads of the POOL engine, 0 runs UEs in the aggregator thread
     uint32_t N = 64; // number of resource blocks (indifidual frequency channels)
+    SchedulerEngine SCHEDULER_ENGINE = SchedulerEngine::LINEAR;
+    PackingPolicy PACKING_POLICY = PackingPolicy::FIRST_FIT;
+    SchedulingPolicy SCHEDULING_POLICY = SchedulingPolicy::FIFO;
 
-    Configuration() {
-        LoadConfig();
-        K = 10 * L;
-    }
-
-private:
-    void LoadConfig() {
-        std::ifstream cfg_stream(CFG_FILE);
+    // Defaults overridden by the key=value lines of a config file, every parameter is printed to log
+    static Configuration load(const std::string& path = CFG_FILE, std::ostream& log = std::cout) {
+        Configuration cfg;
+        std::ifstream cfg_stream(path);
         if (!cfg_stream.is_open()) {
-            std::cerr << "Cannot open " << CFG_FILE << ", using defaults." << std::endl;
-            return;
+            std::cerr << "Cannot open " << path << ", using defaults." << std::endl;
+            return cfg;
         }
         std::string line;
         while(getline(cfg_stream, line)) {
@@ -89,63 +163,99 @@ private:
             if( line.empty() || line[0] == '#' || delimiterPos == std::string::npos) continue;
             auto key = line.substr(0, delimiterPos);
             auto val = line.substr(delimiterPos + 1);
-            ParseKeyValPair(key, val);
-        }
-    }
-
-    void ParseKeyValPair(const std::string& key, const std::string& val) {
-        try {
-            if (key.compare("L") == 0) {
-                L = std::stoul(val);
-            } else if (key.compare("M") == 0) {
-                M = std::stoul(val);
-            } else if (key.compare("N") == 0) {
-                N = std::stoul(val);
-            } else if (key.compare("SIMULATION_PERIOD_SF") == 0) {
-                SIMULATION_PERIOD_SF = std::stoul(val);
-            } else if (key.compare("UE_MODE") == 0) {
-                UE_MODE = val.compare("UPLINK_ONLY") == 0 ? UeMode::UL_ONLY
-                        : val.compare("DOWNLINK_ONLY") == 0 ? UeMode::DL_ONLY
-                        : val.compare("MIXED") == 0 ? UeMode::MIXED
-                        : throw std::range_error("bad UE_MODE value");
-            } else if (key.compare("SF_TIME_SCALE") == 0) {
-                SF_TIME_SCALE = std::chrono::milliseconds(std::stoul(val));
-            } else if (key.compare("DEBUGPRINTS") == 0) {
-                DEBUGPRINTS = std::stoul(val);
-            } else {
-                std::cerr << "Unknown key in config: "<< key << "=" << val << '\n';
-                return;
+            try {
+                if (cfg.set(key, val)) {
+                    log << "Parameter " << key << "=" << val << '\n';
+                } else {
+                    std::cerr << "Unknown key in config: "<< key << "=" << val << '\n';
+                }
+            } catch (std::exception& e) {
+                std::cerr << "Failed to parse " << key << "=" << val << ", exception: " << e.what() << '\n';
             }
-            std::cout << "Parameter " << key << "=" << val << '\n';
-        } catch (std::exception& e) {
-            std::cerr << "Failed to parse " << key << "=" << val << ", exception: " << e.what() << '\n';
         }
+        return cfg;
     }
-} cfg;
 
-template <typename T>
-void SockSend(int sockfd, struct sockaddr_in& servaddr, socklen_t& len, const std::vector<T>& message) {
-    const size_t bytes_to_send = message.size() * sizeof(T);
-    int result = sendto(sockfd, message.data(), bytes_to_send,
-               MSG_CONFIRM, (const struct sockaddr *) &servaddr,
-               len);
-    if(result == -1) {
-        std::cerr << "error " << errno << ": " << strerror(errno);
+    // Sets one parameter from its config file form, returns false for an unknown key; throws on a bad value
+    bool set(const std::string& key, const std::string& val) {
+        if (key.compare("L") == 0) {
+            L = std::stoul(val);
+            if (!explicit_k_) K = 10 * L;
+        } else if (key.compare("K") == 0) {
+            K = std::stoul(val);
+            explicit_k_ = K != 0;
+            if (!explicit_k_) K = 10 * L;
+        } else if (key.compare("STARVATION_SF") == 0) {
+            STARVATION_SF = std::stoul(val);
+        } else if (key.compare("SHORT_L") == 0) {
+            SHORT_L = std::stoul(val);
+        } else if (key.compare("SHORT_SHARE") == 0) {
+            SHORT_SHARE = std::stoul(val);
+        } else if (key.compare("M") == 0) {
+            M = std::stoul(val);
+        } else if (key.compare("CELLS") == 0) {
+            CELLS = std::stoul(val);
+        } else if (key.compare("PIPELINE") == 0) {
+            PIPELINE = std::stoul(val);
+        } else if (key.compare("SHARDS") == 0) {
+            SHARDS = std::stoul(val);
+        } else if (key.compare("N") == 0) {
+            N = std::stoul(val);
+            if (N >= SchedulerResponse::NO_RB) throw std::range_error("bad N value");   // block numbers must not collide with NO_RB
+        } else if (key.compare("SIMULATION_PERIOD_SF") == 0) {
+            SIMULATION_PERIOD_SF = std::stoul(val);
+            if (SIMULATION_PERIOD_SF == 0) throw std::range_error("bad SIMULATION_PERIOD_SF value");
+        } else if (key.compare("UE_MODE") == 0) {
+            UE_MODE = val.compare("UPLINK_ONLY") == 0 ? UeMode::UL_ONLY
+                    : val.compare("DOWNLINK_ONLY") == 0 ? UeMode::DL_ONLY
+                    : val.compare("MIXED") == 0 ? UeMode::MIXED
+                    : throw std::range_error("bad UE_MODE value");
+        } else if (key.compare("UE_ENGINE") == 0) {
+            UE_ENGINE = val.compare("THREADS") == 0 ? UeEngineType::THREADS
+                      : val.compare("POOL") == 0 ? UeEngineType::POOL
+                      : throw std::range_error("bad UE_ENGINE value");
+        } else if (key.compare("UE_WORKERS") == 0) {
+            UE_WORKERS = std::stoul(val);
+        } else if (key.compare("TRANSPORT") == 0) {
+            TRANSPORT = val.compare("UDP") == 0 ? TransportType::UDP
+                      : val.compare("SHM") == 0 ? TransportType::SHM
+                      : throw std::range_error("bad TRANSPORT value");
+        } else if (key.compare("SCHEDULER_ENGINE") == 0) {
+            SCHEDULER_ENGINE = val.compare("LINEAR") == 0 ? SchedulerEngine::LINEAR
+                             : val.compare("INDEXED") == 0 ? SchedulerEngine::INDEXED
+                             : val.compare("BITMAP") == 0 ? SchedulerEngine::BITMAP
+                             : throw std::range_error("bad SCHEDULER_ENGINE value");
+        } else if (key.compare("PACKING_POLICY") == 0) {
+            PACKING_POLICY = val.compare("FIRST_FIT") == 0 ? PackingPolicy::FIRST_FIT
+                           : val.compare("BEST_FIT") == 0 ? PackingPolicy::BEST_FIT
+                           : val.compare("LONGEST_FIRST") == 0 ? PackingPolicy::LONGEST_FIRST
+                           : throw std::range_error("bad PACKING_POLICY value");
+        } else if (key.compare("SCHEDULING_POLICY") == 0) {
+            SCHEDULING_POLICY = val.compare("FIFO") == 0 ? SchedulingPolicy::FIFO
+                              : val.compare("ROUND_ROBIN") == 0 ? SchedulingPolicy::ROUND_ROBIN
+                              : val.compare("PROPORTIONAL_FAIR") == 0 ? SchedulingPolicy::PROPORTIONAL_FAIR
+                              : val.compare("MAX_THROUGHPUT") == 0 ? SchedulingPolicy::MAX_THROUGHPUT
+                              : throw std::range_error("bad SCHEDULING_POLICY value");
+        } else if (key.compare("SF_TIME_SCALE") == 0) {
+            SF_TIME_SCALE = std::chrono::nanoseconds(std::llround(std::stod(val) * 1e6));
+            if (SF_TIME_SCALE.count() <= 0) throw std::range_error("bad SF_TIME_SCALE value");
+        } else if (key.compare("PACING_SPIN_US") == 0) {
+            PACING_SPIN = std::chrono::nanoseconds(std::llround(std::stod(val) * 1e3));
+            if (PACING_SPIN.count() < 0) throw std::range_error("bad PACING_SPIN_US value");
+        } else if (key.compare("VIRTUAL_TIME") == 0) {
+            VIRTUAL_TIME = std::stoul(val);
+        } else if (key.compare("TRACE_RECORD") == 0) {
+            TRACE_RECORD = val;
+        } else if (key.compare("SEED") == 0) {
+            SEED = std::stoul(val);
+        } else if (key.compare("DEBUGPRINTS") == 0) {
+            DEBUGPRINTS = std::stoul(val);
+        } else {
+            return false;
+        }
+        return true;
     }
-}
 
-template <typename T>
-void SockRecv(int sockfd, struct sockaddr_in& servaddr, socklen_t& len, std::vector<T>& message) {
-    message.resize(cfg.M);
-    const size_t bytes_to_receive = message.size() * sizeof(T);
-    int result = recvfrom(sockfd, message.data(), bytes_to_receive,
-               MSG_WAITALL, (struct sockaddr *) &servaddr,
-               &len);
-    if(result == -1) {
-        std::cerr << "error " << errno << ": " << strerror(errno);
-    }
-    if(result % sizeof(T) != 0) {
-        std::cerr << "received " << result << " bytes which is not multple of record size (" << sizeof(T) << ")\n";
-    }
-    message.resize(result / sizeof(T));
-}
+private:
+    bool explicit_k_ = false;
+};
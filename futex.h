@@ -0,0 +1,31 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32-bit integer");
+
+/* Blocks while *word == expected (returns at once if it already differs).
+ * process_shared must be set for words in memory shared between processes.
+ */
+inline void futexWait(std::atomic<uint32_t>& word, uint32_t expected, bool process_shared = false) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), process_shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE,
+            expected, nullptr, nullptr, 0);
+}
+
+inline void futexWake(std::atomic<uint32_t>& word, bool process_shared = false, int waiters = INT_MAX) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), process_shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE,
+            waiters, nullptr, nullptr, 0);
+}
@@ -0,0 +1,198 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "futex.h"
+
+constexpr std::size_t CACHE_LINE = 64;
+
+inline std::size_t ringCapacity(std::size_t min_capacity) {
+    std::size_t capacity = 2;
+    while (capacity < min_capacity) capacity <<= 1;
+    return capacity;
+}
+
+/* Bounded multi-producer single-consumer ring (per-cell sequence numbers).
+ * Producers claim a cell with one CAS on the tail; the consumer takes every
+ * published item in one drain() without touching the producers' cache line.
+ * push() on a full ring sleeps until the next drain frees cells.
+ */
+template <typename T>
+class MpscRing {
+    struct Cell {
+        std::atomic<std::size_t> seq;
+        T value;
+    };
+
+    std::size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(CACHE_LINE) std::atomic<std::size_t> tail_{0};  // next cell to claim, producers
+    alignas(CACHE_LINE) std::size_t head_ = 0;              // next cell to consume, consumer only
+    std::atomic<uint32_t> drains_{0};                       // futex word for producers waiting on a full ring
+    std::atomic<bool> producers_waiting_{false};
+
+  public:
+    explicit MpscRing(std::size_t min_capacity)
+      : mask_(ringCapacity(min_capacity) - 1),
+        cells_(new Cell[mask_ + 1]) {
+        for (std::size_t i = 0; i <= mask_; i++) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator = (const MpscRing&) = delete;
+
+    // Returns false if the ring is full
+    bool tryPush(const T& item) {
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            const std::size_t seq = cell.seq.load(std::memory_order_acquire);
+            const auto dif = static_cast<std::ptrdiff_t>(seq - pos);
+            if (dif == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = item;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void push(const T& item) {
+        while (!tryPush(item)) {
+            const uint32_t drains = drains_.load();
+            producers_waiting_.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (tryPush(item)) return;
+            futexWait(drains_, drains);
+        }
+    }
+
+    // Appends every published item to out, returns their number
+    std::size_t drain(std::vector<T>& out) {
+        std::size_t drained = 0;
+        while (true) {
+            Cell& cell = cells_[head_ & mask_];
+            if (cell.seq.load(std::memory_order_acquire) != head_ + 1) break;
+            out.push_back(cell.value);
+            cell.seq.store(head_ + mask_ + 1, std::memory_order_release);
+            head_++;
+            drained++;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (drained && producers_waiting_.load(std::memory_order_relaxed)) {
+            producers_waiting_.store(false, std::memory_order_relaxed);
+            drains_.fetch_add(1);
+            futexWake(drains_);
+        }
+        return drained;
+    }
+};
+
+/* Bounded single-producer single-consumer ring, push and pop are wait-free.
+ * Each side caches the other side's index and only reloads it when the ring
+ * looks full (or empty).
+ */
+template <typename T>
+class SpscRing {
+    std::size_t mask_;
+    std::unique_ptr<T[]> items_;
+    alignas(CACHE_LINE) std::atomic<std::size_t> tail_{0};
+    std::size_t head_cache_ = 0;                            // producer's view of head_
+    alignas(CACHE_LINE) std::atomic<std::size_t> head_{0};
+    std::size_t tail_cache_ = 0;                            // consumer's view of tail_
+
+  public:
+    explicit SpscRing(std::size_t min_capacity)
+      : mask_(ringCapacity(min_capacity) - 1),
+        items_(new T[mask_ + 1]) {
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator = (const SpscRing&) = delete;
+
+    bool tryPush(const T& item) {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ > mask_) return false;
+        }
+        items_[tail & mask_] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) return false;
+        }
+        item = items_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, true if nothing is left to pop
+    bool empty() const { return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire); }
+};
+
+/* SpscRing with a blocking pop for consumers that have nothing else to do.
+ * The consumer sleeps on a futex event counter, the producer only pays for a
+ * wake-up syscall once per sleep.
+ */
+template <typename T>
+class SpscChannel {
+    SpscRing<T> ring_;
+    std::atomic<uint32_t> events_{0};
+    std::atomic<bool> sleeping_{false};
+    std::atomic<bool> done_{false};
+
+    void signal() {
+        events_.fetch_add(1);
+        if (sleeping_.load() && sleeping_.exchange(false)) futexWake(events_);
+    }
+
+  public:
+    explicit SpscChannel(std::size_t min_capacity = 2) : ring_(min_capacity) {}
+
+    bool tryPush(const T& item) {
+        if (!ring_.tryPush(item)) return false;
+        signal();
+        return true;
+    }
+
+    bool tryPop(T& item) { return ring_.tryPop(item); }
+
+    // Waits for an item, returns false once done() is called
+    bool pop(T& item) {
+        while (true) {
+            const uint32_t events = events_.load();
+            if (done_.load(std::memory_order_relaxed)) return false;
+            if (ring_.tryPop(item)) return true;
+            sleeping_.store(true);
+            futexWait(events_, events);
+        }
+    }
+
+    void done() {
+        done_.store(true);
+        signal();
+    }
+};
@@ -0,0 +1,166 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+inline uint64_t monotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Log-linear buckets of non-negative integers: exact below 16, then 16
+ * linear buckets per power of two (at most 1/16 relative error).
+ */
+struct LogLinearBuckets {
+    static constexpr unsigned SUB_BITS = 4;
+    static constexpr unsigned SUB_BUCKETS = 1U << SUB_BITS;
+    static constexpr unsigned NUM_BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    static unsigned bucketOf(uint64_t val) {
+        if (val < SUB_BUCKETS) return val;
+        const unsigned exp = 63 - __builtin_clzll(val);
+        return (exp - SUB_BITS + 1) * SUB_BUCKETS + ((val >> (exp - SUB_BITS)) & (SUB_BUCKETS - 1));
+    }
+
+    // Largest value falling into bucket
+    static uint64_t bucketUpper(unsigned bucket) {
+        if (bucket < SUB_BUCKETS) return bucket;
+        const unsigned exp = bucket / SUB_BUCKETS + SUB_BITS - 1;
+        const uint64_t sub = bucket % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << (exp - SUB_BITS)) - 1;
+    }
+};
+
+/* Log-linear histogram of nanosecond durations, see LogLinearBuckets. Recording
+ * is a few relaxed atomic adds, so any number of threads may record at once
+ * and a dump may run concurrently.
+ */
+class LatencyHistogram {
+    using Buckets = LogLinearBuckets;
+
+    const char* name_;
+    std::atomic<uint64_t> counts_[Buckets::NUM_BUCKETS]{};
+    std::atomic<uint64_t> total_{0};
+    std::atomic<uint64_t> max_{0};
+
+  public:
+    explicit LatencyHistogram(const char* name) : name_(name) {}
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator = (const LatencyHistogram&) = delete;
+
+    const char* name() const { return name_; }
+
+    // Records count samples of ns nanoseconds
+    void record(uint64_t ns, uint64_t count = 1) {
+        if (!count) return;
+        counts_[Buckets::bucketOf(ns)].fetch_add(count, std::memory_order_relaxed);
+        total_.fetch_add(count, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (ns > max && !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+    }
+
+    // Records the time since start_ns, a monotonicNs() value
+    void recordSince(uint64_t start_ns) { record(monotonicNs() - start_ns); }
+
+    // Adds the samples of other, which may still be recording
+    void merge(const LatencyHistogram& other) {
+        for (unsigned bucket = 0; bucket < Buckets::NUM_BUCKETS; bucket++) {
+            counts_[bucket].fetch_add(other.counts_[bucket].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        total_.fetch_add(other.count(), std::memory_order_relaxed);
+        const uint64_t other_max = other.max();
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (other_max > max && !max_.compare_exchange_weak(max, other_max, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    // Upper bound of the q-quantile, 0 if nothing was recorded
+    uint64_t quantile(double q) const {
+        const uint64_t total = count();
+        if (!total) return 0;
+        const uint64_t rank = std::max<uint64_t>(1, q * total + 0.5);
+        uint64_t seen = 0;
+        for (unsigned bucket = 0; bucket < Buckets::NUM_BUCKETS; bucket++) {
+            seen += counts_[bucket].load(std::memory_order_relaxed);
+            if (seen >= rank) return std::min(Buckets::bucketUpper(bucket), max());
+        }
+        return max();
+    }
+};
+
+// Number of times something happened, any thread may add to it
+class EventCounter {
+    const char* name_;
+    std::atomic<uint64_t> count_{0};
+
+  public:
+    explicit EventCounter(const char* name) : name_(name) {}
+
+    EventCounter(const EventCounter&) = delete;
+    EventCounter& operator = (const EventCounter&) = delete;
+
+    const char* name() const { return name_; }
+    void add(uint64_t count = 1) { count_.fetch_add(count, std::memory_order_relaxed); }
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    void merge(const EventCounter& other) { add(other.count()); }
+};
+
+// Prints count and p50/p99/p999/max in microseconds of every histogram, then the counters
+inline void dumpMetrics(std::ostream& os, const std::vector<const LatencyHistogram*>& histograms,
+                        const std::vector<const EventCounter*>& counters = {}) {
+    const auto us = [](uint64_t ns) { return ns / 1000.0; };
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << "\n" << std::left << std::setw(20) << "Latency, us" << std::right
+        << std::setw(12) << "count" << std::setw(10) << "p50" << std::setw(10) << "p99"
+        << std::setw(10) << "p999" << std::setw(12) << "max" << "\n";
+    for (const auto* histogram : histograms) {
+        out << std::left << std::setw(20) << histogram->name() << std::right << std::setw(12) << histogram->count()
+            << std::setw(10) << us(histogram->quantile(0.5)) << std::setw(10) << us(histogram->quantile(0.99))
+            << std::setw(10) << us(histogram->quantile(0.999)) << std::setw(12) << us(histogram->max()) << "\n";
+    }
+    if (!counters.empty()) out << "\n" << std::left << std::setw(20) << "Events" << std::right << std::setw(12) << "count" << "\n";
+    for (const auto* counter : counters) {
+        out << std::left << std::setw(20) << counter->name() << std::right << std::setw(12) << counter->count() << "\n";
+    }
+    os << out.str() << std::flush;
+}
+
+/* Calls dump() whenever the process gets SIGUSR1. Must be called before any
+ * other thread starts: SIGUSR1 is blocked in the calling thread and the
+ * threads it creates, and a detached thread waits for it.
+ */
+template <typename Dump>
+void onSignal(Dump dump) {
+    sigset_t usr1;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1, nullptr);
+    std::thread([usr1, dump]() {
+        int sig;
+        while (sigwait(&usr1, &sig) == 0) dump();
+    }).detach();
+}
+
+// Dumps the histograms and counters to stdout on SIGUSR1, see onSignal()
+inline void dumpMetricsOnSignal(std::vector<const LatencyHistogram*> histograms, std::vector<const EventCounter*> counters = {}) {
+    onSignal([histograms, counters]() { dumpMetrics(std::cout, histograms, counters); });
+}
@@ -0,0 +1,125 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include "window.h"
+
+/* Ring of per-resource-block grids: each subframe is a bitset of N resource
+ * blocks packed into 64-bit words (one word for N <= 64), a set bit is a used
+ * block. A run occupies the same resource block in data_len consecutive
+ * subframes, so unlike the counter engines a run only fits where one block is
+ * free in every subframe it covers. Free blocks are found with ctz over the
+ * complement of the OR-ed run, loads are popcounts.
+ * Memory: a subframe costs 8 bytes per 64 blocks, twice the 4-byte counter of
+ * the counter engines for N <= 64 and more above. That buys knowing which
+ * blocks are used; count-only runs are cheaper in CounterWindow.
+ */
+class BitmapWindow {
+    unsigned words_;                // 64-bit words per subframe
+    unsigned mask_;
+    uint64_t last_word_mask_;       // valid bits of the last word of a subframe
+    std::vector<uint64_t> grid_;
+
+    uint64_t* row(unsigned sf) { return grid_.data() + (sf & mask_) * words_; }
+    const uint64_t* row(unsigned sf) const { return grid_.data() + (sf & mask_) * words_; }
+
+    // Free blocks of word w shared by all subframes in [sf, sf + data_len)
+    uint64_t freeRun(unsigned sf, unsigned data_len, unsigned w) const {
+        uint64_t used = w + 1 == words_ ? ~last_word_mask_ : 0;
+        for (unsigned s = sf; s < sf + data_len && ~used; s++) used |= row(s)[w];
+        return ~used;
+    }
+
+  public:
+    BitmapWindow(unsigned window_len, unsigned rb_per_sf)
+      : words_((rb_per_sf + 63) / 64),
+        mask_(ringSize(window_len) - 1),
+        last_word_mask_(rb_per_sf % 64 ? (uint64_t{1} << (rb_per_sf % 64)) - 1 : ~uint64_t{0}),
+        grid_(std::size_t{ringSize(window_len)} * words_) {
+    }
+
+    unsigned load(unsigned sf) const {
+        unsigned blocks = 0;
+        for (unsigned w = 0; w < words_; w++) blocks += __builtin_popcountll(row(sf)[w]);
+        return blocks;
+    }
+
+    unsigned retire(unsigned sf) {
+        const unsigned blocks = load(sf);
+        for (unsigned w = 0; w < words_; w++) row(sf)[w] = 0;
+        return blocks;
+    }
+
+    bool used(unsigned sf, unsigned rb) const {
+        return row(sf)[rb / 64] >> (rb % 64) & 1;
+    }
+
+    unsigned reserve(unsigned from, unsigned to, unsigned data_len, unsigned num, Allocation* out) {
+        unsigned num_reserved = 0;
+        for (unsigned first = from; num_reserved < num && first + data_len <= to; first++) {
+            for (unsigned w = 0; w < words_ && num_reserved < num; w++) {
+                for (uint64_t free = freeRun(first, data_len, w); free && num_reserved < num; free &= free - 1) {
+                    const unsigned bit = __builtin_ctzll(free);
+                    for (unsigned sf = first; sf < first + data_len; sf++) row(sf)[w] |= uint64_t{1} << bit;
+                    if (out) out[num_reserved] = {first, w * 64 + bit};
+                    num_reserved++;
+                }
+            }
+        }
+        return num_reserved;
+    }
+
+    unsigned findFit(unsigned from, unsigned to, unsigned len) const {
+        for (unsigned sf = from; sf + len <= to; sf++) {
+            for (unsigned w = 0; w < words_; w++) {
+                if (freeRun(sf, len, w)) return sf;
+            }
+        }
+        return to;
+    }
+
+    unsigned runCapacity(unsigned sf, unsigned len) const {
+        unsigned runs = 0;
+        for (unsigned w = 0; w < words_; w++) runs += __builtin_popcountll(freeRun(sf, len, w));
+        return runs;
+    }
+
+    Allocation place(unsigned sf, unsigned len) {
+        for (unsigned w = 0; w < words_; w++) {
+            const uint64_t free = freeRun(sf, len, w);
+            if (!free) continue;
+            const unsigned bit = __builtin_ctzll(free);
+            for (unsigned s = sf; s < sf + len; s++) row(s)[w] |= uint64_t{1} << bit;
+            return {sf, w * 64 + bit};
+        }
+        return {Allocation::NO_SUBFRAME, Allocation::NO_RB};
+    }
+
+    void adjust(const Allocation& run, unsigned from, unsigned to, int delta) {
+        const uint64_t bit = uint64_t{1} << (run.rb % 64);
+        for (unsigned sf = from; sf < to; sf++) {
+            if (delta > 0) row(sf)[run.rb / 64] |= bit;
+            else row(sf)[run.rb / 64] &= ~bit;
+        }
+    }
+
+    bool extendable(const Allocation& run, unsigned from, unsigned to) const {
+        for (unsigned sf = from; sf < to; sf++) {
+            if (used(sf, run.rb)) return false;
+        }
+        return true;
+    }
+
+    uint64_t sum(unsigned from, unsigned to) const {
+        uint64_t blocks = 0;
+        for (unsigned sf = from; sf < to; sf++) blocks += load(sf);
+        return blocks;
+    }
+};
@@ -0,0 +1,210 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+#include "scheduler.h"
+#include "policy.h"
+#include "../common.h"
+#include "../metrics.h"
+#include "../async_log.h"
+#include "../trace.h"
+
+/* Hot path timings and events of the server, dumped at exit and on SIGUSR1.
+ * Every shard records into its own and dumps merge them, so shards do not
+ * share the cache lines of their histograms.
+ */
+struct ServerMetrics {
+    LatencyHistogram receive_wait{"receive wait"};
+    LatencyHistogram ul_reserve{"UL reserve"};
+    LatencyHistogram dl_reserve{"DL reserve"};
+    LatencyHistogram build{"response build"};
+    LatencyHistogram send{"send"};
+
+    EventCounter missed_batches{"missed batches"};      // not complete by the deadline of their subframe
+    EventCounter late_batches{"late batches"};          // completed after it, answered with failures
+    EventCounter rejected_frames{"rejected frames"};    // malformed, stale or for another shard
+    EventCounter socket_drops{"socket drops"};          // datagrams dropped by a full receive buffer
+    EventCounter full_receives{"full receives"};        // receives that filled every slot, more was waiting
+    EventCounter rx_stalls{"RX stalls"};                // pipeline RX waited for a free slot
+
+    std::vector<const LatencyHistogram*> all() const {
+        return {&receive_wait, &ul_reserve, &dl_reserve, &build, &send};
+    }
+
+    std::vector<const EventCounter*> counters() const {
+        return {&missed_batches, &late_batches, &rejected_frames, &socket_drops, &full_receives, &rx_stalls};
+    }
+
+    void merge(const ServerMetrics& other) {
+        receive_wait.merge(other.receive_wait);
+        ul_reserve.merge(other.ul_reserve);
+        dl_reserve.merge(other.dl_reserve);
+        build.merge(other.build);
+        send.merge(other.send);
+        missed_batches.merge(other.missed_batches);
+        late_batches.merge(other.late_batches);
+        rejected_frames.merge(other.rejected_frames);
+        socket_drops.merge(other.socket_drops);
+        full_receives.merge(other.full_receives);
+        rx_stalls.merge(other.rx_stalls);
+    }
+};
+
+// Default metrics of cells and inboxes not given their own, as in the tools
+inline ServerMetrics server_metrics;
+
+// Requests of one cell's subframe split by direction, and their allocations
+struct CellBatch {
+    unsigned subframe = 0;
+    std::vector<unsigned> ul_lengths{};
+    std::vector<unsigned> dl_lengths{};
+    std::vector<unsigned> ul_ues{};         // UE of each request, numbered within the cell
+    std::vector<unsigned> dl_ues{};
+    std::vector<unsigned> ul_order{};       // order the scheduling policy serves requests in
+    std::vector<unsigned> dl_order{};
+    std::vector<Allocation> ul_allocations{};
+    std::vector<Allocation> dl_allocations{};
+    unsigned ul_allocated = 0;
+    unsigned dl_allocated = 0;
+};
+
+/* One eNB: an uplink and a downlink scheduler and the subframe the next
+ * batch of requests belongs to. Every batch, empty or not, is one subframe.
+ * schedule() runs the steps of a batch in sequence; decode(), the per
+ * direction steps and respond() may run on different threads as long as each
+ * step is called in batch order and only from one thread.
+ * Step timings go to the server's metrics unless the cell is given others.
+ */
+template <typename Sched>
+class Cell {
+    const Configuration& cfg_;
+    uint32_t id_;
+    ServerMetrics& metrics_;
+    unsigned current_sf_ = 0;
+    CellBatch batch_{};
+
+  public:
+    Sched uplink;
+    Sched downlink;
+    UeTable ul_ue_table;
+    UeTable dl_ue_table;
+
+    explicit Cell(const Configuration& cfg, uint32_t id = 0, ServerMetrics& metrics = server_metrics)
+      : cfg_(cfg),
+        id_(id),
+        metrics_(metrics),
+        uplink(cfg.K, cfg.N),
+        downlink(cfg.K, cfg.N),
+        ul_ue_table(cfg.M),
+        dl_ue_table(cfg.M) {
+    }
+
+    uint32_t id() const { return id_; }
+    unsigned currentSubframe() const { return current_sf_; }
+
+    /* Assigns the batch to subframe sf, moves on to the next one and splits
+     * requests by direction. Subframes between the current one and sf had no batch.
+     */
+    void decode(unsigned sf, Span<const ResourceRequest> requests, CellBatch& batch) {
+        assert(sf >= current_sf_);
+        batch.subframe = sf;
+        current_sf_ = sf + 1;
+        if (cfg_.DEBUGPRINTS) logSubframe(cfg_.CELLS > 1 ? id_ : LogRecord::NO_CELL, batch.subframe);
+        if (trace_writer.isOpen()) trace_writer.record(id_, batch.subframe, requests);
+        batch.ul_lengths.clear();
+        batch.dl_lengths.clear();
+        batch.ul_ues.clear();
+        batch.dl_ues.clear();
+        for (auto req : requests) {
+            if (cfg_.DEBUGPRINTS) logRequest(req);
+            if (req.resource_type == ResourceType::UL) {
+                batch.ul_lengths.push_back(req.data_length);
+                batch.ul_ues.push_back(req.ue_id % cfg_.M);
+            } else if (req.resource_type == ResourceType::DL) {
+                batch.dl_lengths.push_back(req.data_length);
+                batch.dl_ues.push_back(req.ue_id % cfg_.M);
+            } else {
+                std::cerr << "Invalid resource_type requested\n";
+            }
+        }
+    }
+
+    // Assigns the batch to the current subframe
+    void decode(Span<const ResourceRequest> requests, CellBatch& batch) { decode(current_sf_, requests, batch); }
+
+    void scheduleUplink(CellBatch& batch) {
+        const uint64_t start = monotonicNs();
+        ul_ue_table.rank(cfg_.SCHEDULING_POLICY, batch.subframe, batch.ul_ues, batch.ul_lengths, batch.ul_order);
+        batch.ul_allocated = uplink.pack(batch.subframe, batch.ul_lengths, cfg_.PACKING_POLICY, batch.ul_allocations, batch.ul_order);
+        ul_ue_table.update(batch.subframe, batch.ul_ues, batch.ul_lengths, batch.ul_allocations);
+        metrics_.ul_reserve.recordSince(start);
+    }
+
+    void scheduleDownlink(CellBatch& batch) {
+        const uint64_t start = monotonicNs();
+        dl_ue_table.rank(cfg_.SCHEDULING_POLICY, batch.subframe, batch.dl_ues, batch.dl_lengths, batch.dl_order);
+        batch.dl_allocated = downlink.pack(batch.subframe, batch.dl_lengths, cfg_.PACKING_POLICY, batch.dl_allocations, batch.dl_order);
+        dl_ue_table.update(batch.subframe, batch.dl_ues, batch.dl_lengths, batch.dl_allocations);
+        metrics_.dl_reserve.recordSince(start);
+    }
+
+    // out receives one response per request, in request order; returns their number
+    unsigned respond(Span<const ResourceRequest> requests, const CellBatch& batch, SchedulerResponse* out) const {
+        if (requests.empty()) return 0;
+        const uint64_t start = monotonicNs();
+        if (cfg_.DEBUGPRINTS) {
+            if (!batch.ul_lengths.empty()) logAllocated(ResourceType::UL, batch.ul_allocated, batch.ul_lengths.size());
+            if (!batch.dl_lengths.empty()) logAllocated(ResourceType::DL, batch.dl_allocated, batch.dl_lengths.size());
+        }
+
+        // Allocations of each direction are in the order of its requests
+        unsigned responded = 0;
+        unsigned ul_responded = 0;
+        unsigned dl_responded = 0;
+        for (auto req : requests) {
+            Allocation allocation{Allocation::NO_SUBFRAME, Allocation::NO_RB};
+            if (req.resource_type == ResourceType::UL) {
+                allocation = batch.ul_allocations[ul_responded++];
+            } else if (req.resource_type == ResourceType::DL) {
+                allocation = batch.dl_allocations[dl_responded++];
+            }
+            if (allocation.subframe != Allocation::NO_SUBFRAME) {
+                const uint16_t rb = allocation.rb == Allocation::NO_RB ? SchedulerResponse::NO_RB : allocation.rb;
+                out[responded++] = {req.ue_id, AllocationStatus::SUCCESS, rb, allocation.subframe};
+            } else {
+                out[responded++] = {req.ue_id, AllocationStatus::FAIL, SchedulerResponse::NO_RB, 0};
+            }
+        }
+        metrics_.build.recordSince(start);
+        return responded;
+    }
+
+    // Answers a batch that missed its deadline without scheduling it: every request fails
+    unsigned reject(Span<const ResourceRequest> requests, SchedulerResponse* out) const {
+        unsigned responded = 0;
+        for (auto req : requests) out[responded++] = {req.ue_id, AllocationStatus::FAIL, SchedulerResponse::NO_RB, 0};
+        return responded;
+    }
+
+    /* Schedules the batch of subframe sf and moves on to the next one.
+     * out receives one response per request, in request order; returns their number.
+     */
+    unsigned schedule(unsigned sf, Span<const ResourceRequest> requests, SchedulerResponse* out) {
+        decode(sf, requests, batch_);
+        if (requests.empty()) return 0;
+        scheduleUplink(batch_);
+        scheduleDownlink(batch_);
+        return respond(requests, batch_, out);
+    }
+
+    // Schedules the batch of the current subframe
+    unsigned schedule(Span<const ResourceRequest> requests, SchedulerResponse* out) { return schedule(current_sf_, requests, out); }
+};
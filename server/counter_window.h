@@ -0,0 +1,212 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+
+#include "window.h"
+#include "simd.h"
+
+// Window sizes read at run time, any K x N window and run length
+class RuntimeSizes {
+    unsigned rb_per_sf_;
+    unsigned mask_;
+
+  public:
+    RuntimeSizes(unsigned window_len, unsigned rb_per_sf) : rb_per_sf_(rb_per_sf), mask_(ringSize(window_len) - 1) {}
+    unsigned rbPerSf() const { return rb_per_sf_; }
+    unsigned mask() const { return mask_; }
+    template <typename Kernel>
+    static unsigned withLength(unsigned len, Kernel kernel) { return kernel(len); }
+};
+
+/* Sizes of a production profile as compile-time constants: N blocks per
+ * subframe, a K-subframe window and runs of length L. The block limit and
+ * the ring mask fold into immediates, and runs of length L reach the run
+ * arithmetic and runCapacityOf()'s fixed-count loop as a constant; other
+ * lengths (short requests) keep the run-time length. findBelow() and addTo()
+ * still scan stretches whose length is only known at run time.
+ */
+template <unsigned L, unsigned N, unsigned K>
+struct FixedSizes {
+    static_assert(L > 0 && N > 0 && K > 0, "empty profile");
+
+    FixedSizes(unsigned window_len, unsigned rb_per_sf) {
+        assert(window_len == K && rb_per_sf == N);
+        (void)window_len;
+        (void)rb_per_sf;
+    }
+    static constexpr unsigned rbPerSf() { return N; }
+    static constexpr unsigned mask() { return ringSize(K) - 1; }
+    template <typename Kernel>
+    static unsigned withLength(unsigned len, Kernel kernel) {
+        if (len == L) return kernel(std::integral_constant<unsigned, L>{});
+        return kernel(len);
+    }
+};
+
+/* Ring of per-subframe counters, first-fit by linear scan.
+ *
+ * All runs of one reserve() call have the same length, so the window is swept
+ * once: between events (a free subframe, or the end of an earlier run) the
+ * number of runs covering a subframe is constant, so the free-slot scan and
+ * the counter increments are vector kernels over the stretch. Cost is
+ * O(K / vector width + placements) instead of O(num * (K + L)).
+ * Sizes is RuntimeSizes or a FixedSizes profile.
+ */
+template <typename Sizes>
+class BasicCounterWindow {
+    Sizes sizes_;
+    std::vector<unsigned> subframes;
+    std::vector<std::pair<unsigned, unsigned>> runs_;  // (first subframe, count) of runs being placed
+
+    unsigned& at(unsigned sf) { return subframes[sf & sizes_.mask()]; }
+    unsigned at(unsigned sf) const { return subframes[sf & sizes_.mask()]; }
+
+    // First subframe in [from, to) with less than limit blocks reserved, to if none
+    unsigned findBelowRing(unsigned from, unsigned to, unsigned limit) const {
+        while (from < to) {
+            const unsigned slot = from & sizes_.mask();
+            const unsigned len = std::min(to - from, sizes_.mask() + 1 - slot);
+            const unsigned found = findBelow(subframes.data() + slot, len, limit);
+            if (found < len) return from + found;
+            from += len;
+        }
+        return to;
+    }
+
+    void addRing(unsigned from, unsigned to, unsigned val) {
+        while (from < to) {
+            const unsigned slot = from & sizes_.mask();
+            const unsigned len = std::min(to - from, sizes_.mask() + 1 - slot);
+            addTo(subframes.data() + slot, len, val);
+            from += len;
+        }
+    }
+
+  public:
+    BasicCounterWindow(unsigned window_len, unsigned rb_per_sf)
+      : sizes_(window_len, rb_per_sf),
+        subframes(ringSize(window_len)),
+        runs_() {
+        runs_.reserve(ringSize(window_len));
+    }
+
+    unsigned load(unsigned sf) const { return at(sf); }
+
+    unsigned retire(unsigned sf) {
+        const unsigned blocks = at(sf);
+        at(sf) = 0;
+        return blocks;
+    }
+
+    unsigned reserve(unsigned from, unsigned to, unsigned data_len, unsigned num, Allocation* out) {
+        if (num == 0 || data_len == 0) {
+            for (unsigned i = 0; out && i < num; i++) out[i] = {from, Allocation::NO_RB};
+            return num;
+        }
+        return Sizes::withLength(data_len, [&](auto len) { return reserveRuns(from, to, len, num, out); });
+    }
+
+    unsigned findFit(unsigned from, unsigned to, unsigned len) const {
+        if (len == 0) return from;
+        return Sizes::withLength(len, [&](auto run_len) { return findFitOf(from, to, run_len); });
+    }
+
+    unsigned runCapacity(unsigned sf, unsigned len) const {
+        return Sizes::withLength(len, [&](auto run_len) { return runCapacityOf(sf, run_len); });
+    }
+
+    Allocation place(unsigned sf, unsigned len) {
+        addRing(sf, sf + len, 1);
+        return {sf, Allocation::NO_RB};
+    }
+
+    // Counters wrap, so adding the two's complement of a block removes it
+    void adjust(const Allocation&, unsigned from, unsigned to, int delta) {
+        addRing(from, to, static_cast<unsigned>(delta));
+    }
+
+    bool extendable(const Allocation&, unsigned from, unsigned to) const {
+        return from == to || runCapacity(from, to - from) > 0;
+    }
+
+    uint64_t sum(unsigned from, unsigned to) const {
+        uint64_t blocks = 0;
+        for (unsigned sf = from; sf < to; sf++) blocks += at(sf);
+        return blocks;
+    }
+
+  private:
+    // Len is unsigned or std::integral_constant, kernels are instantiated for both
+    template <typename Len>
+    unsigned reserveRuns(unsigned from, unsigned to, Len data_len, unsigned num, Allocation* out) {
+        const unsigned rb_per_sf = sizes_.rbPerSf();
+        runs_.clear();
+        std::size_t oldest = 0;    // earliest run still covering sf
+        unsigned active = 0;       // runs covering sf
+        unsigned num_reserved = 0;
+        bool placing = true;
+        unsigned sf = from;
+        while (sf < to) {
+            const unsigned next_end = oldest < runs_.size() ? runs_[oldest].first + data_len : to;
+            if (placing) {
+                // a subframe is free while its load plus covering runs stays below rb_per_sf
+                const unsigned limit = active < rb_per_sf ? rb_per_sf - active : 0;
+                const unsigned free_sf = findBelowRing(sf, next_end, limit);
+                addRing(sf, free_sf, active);
+                sf = free_sf;
+                if (sf < next_end) {
+                    if (sf + data_len > to) {
+                        placing = false;
+                        continue;
+                    }
+                    const unsigned runs = std::min(num - num_reserved, limit - at(sf));
+                    for (unsigned i = 0; out && i < runs; i++) out[num_reserved + i] = {sf, Allocation::NO_RB};
+                    runs_.emplace_back(sf, runs);
+                    active += runs;
+                    num_reserved += runs;
+                    placing = num_reserved < num;
+                    continue;
+                }
+            } else {
+                if (active == 0) break;
+                addRing(sf, next_end, active);
+                sf = next_end;
+            }
+            if (oldest < runs_.size()) active -= runs_[oldest++].second;
+        }
+        return num_reserved;
+    }
+
+    template <typename Len>
+    unsigned findFitOf(unsigned from, unsigned to, Len len) const {
+        unsigned start = from;  // first subframe after the last full one
+        for (unsigned sf = from; sf < to; sf++) {
+            if (at(sf) >= sizes_.rbPerSf()) start = sf + 1;
+            else if (sf + 1 - start == len) return start;
+        }
+        return to;
+    }
+
+    template <typename Len>
+    unsigned runCapacityOf(unsigned sf, Len len) const {
+        unsigned max_load = 0;
+        for (unsigned s = 0; s < len; s++) max_load = std::max(max_load, at(sf + s));
+        return max_load < sizes_.rbPerSf() ? sizes_.rbPerSf() - max_load : 0;
+    }
+};
+
+using CounterWindow = BasicCounterWindow<RuntimeSizes>;
+
+template <unsigned L, unsigned N, unsigned K>
+using FixedCounterWindow = BasicCounterWindow<FixedSizes<L, N, K>>;
@@ -0,0 +1,73 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <vector>
+#include <cassert>
+#include <cstdint>
+
+/* Per-subframe block counts of a reservation ring as a pair of Fenwick trees:
+ * adding to a range of subframes and summing a range are both O(log size).
+ * Like the windows it is indexed by absolute subframe number, ranges may wrap
+ * around the ring but must not be longer than it.
+ */
+class RingFenwick {
+    unsigned size_;                     // power of two
+    std::vector<int64_t> add_;          // Fenwick tree of the values added at a position
+    std::vector<int64_t> weighted_;     // same, times the position
+
+    void update(unsigned pos, int64_t val) {
+        const int64_t weighted = val * pos;
+        for (unsigned i = pos + 1; i <= size_; i += i & -i) {
+            add_[i] += val;
+            weighted_[i] += weighted;
+        }
+    }
+
+    // Sum of ring slots [0, pos)
+    int64_t prefix(unsigned pos) const {
+        int64_t add = 0;
+        int64_t weighted = 0;
+        for (unsigned i = pos; i > 0; i -= i & -i) {
+            add += add_[i];
+            weighted += weighted_[i];
+        }
+        return add * pos - weighted;
+    }
+
+    // Adds val to ring slots [first, last) that do not wrap
+    void addSlots(unsigned first, unsigned last, int64_t val) {
+        update(first, val);
+        if (last < size_) update(last, -val);
+    }
+
+  public:
+    explicit RingFenwick(unsigned size) : size_(size), add_(size + 1), weighted_(size + 1) {
+        assert((size & (size - 1)) == 0);
+    }
+
+    void add(unsigned from, unsigned to, int64_t val) {
+        assert(to - from <= size_);
+        if (from == to) return;
+        const unsigned first = from & (size_ - 1);
+        const unsigned last = first + (to - from);
+        if (last <= size_) {
+            addSlots(first, last, val);
+        } else {
+            addSlots(first, size_, val);
+            addSlots(0, last - size_, val);
+        }
+    }
+
+    int64_t sum(unsigned from, unsigned to) const {
+        assert(to - from <= size_);
+        const unsigned first = from & (size_ - 1);
+        const unsigned last = first + (to - from);
+        if (last <= size_) return prefix(last) - prefix(first);
+        return prefix(size_) - prefix(first) + prefix(last - size_);
+    }
+};
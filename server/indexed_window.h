@@ -0,0 +1,227 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include "window.h"
+
+/* Ring of per-subframe counters indexed by a lazy segment tree (min, max and
+ * sum per node, pending range-add per node). First free subframe lookup and
+ * reservation of a data_len run are O(log K) each; results are identical to
+ * CounterWindow first-fit.
+ */
+class IndexedWindow {
+    static constexpr unsigned NONE = ~0U;
+
+    unsigned rb_per_sf_;
+    unsigned size_;                 // ring slots, power of two
+    std::vector<unsigned> min_;     // heap layout, root at 1, leaves at size_ + slot
+    std::vector<unsigned> max_;
+    std::vector<uint64_t> sum_;
+    std::vector<int> lazy_;         // pending add of the children, negative after releases
+
+    // val is negative when runs are released, min and max wrap around like counters
+    void apply(unsigned node, unsigned len, int val) {
+        min_[node] += val;
+        max_[node] += val;
+        sum_[node] += static_cast<int64_t>(val) * len;
+        if (len > 1) lazy_[node] += val;
+    }
+
+    void push(unsigned node, unsigned len) {
+        if (lazy_[node] == 0) return;
+        apply(2 * node, len / 2, lazy_[node]);
+        apply(2 * node + 1, len / 2, lazy_[node]);
+        lazy_[node] = 0;
+    }
+
+    void pull(unsigned node) {
+        min_[node] = std::min(min_[2 * node], min_[2 * node + 1]);
+        max_[node] = std::max(max_[2 * node], max_[2 * node + 1]);
+        sum_[node] = sum_[2 * node] + sum_[2 * node + 1];
+    }
+
+    void add(unsigned node, unsigned nl, unsigned nr, unsigned l, unsigned r, int val) {
+        if (r <= nl || nr <= l) return;
+        if (l <= nl && nr <= r) {
+            apply(node, nr - nl, val);
+            return;
+        }
+        push(node, nr - nl);
+        const unsigned mid = (nl + nr) / 2;
+        add(2 * node, nl, mid, l, r, val);
+        add(2 * node + 1, mid, nr, l, r, val);
+        pull(node);
+    }
+
+    // First slot in [l, r) with value below limit, NONE if there is none
+    unsigned findBelow(unsigned node, unsigned nl, unsigned nr, unsigned l, unsigned r, unsigned limit) {
+        if (r <= nl || nr <= l || min_[node] >= limit) return NONE;
+        if (nr - nl == 1) return nl;
+        push(node, nr - nl);
+        const unsigned mid = (nl + nr) / 2;
+        const unsigned found = findBelow(2 * node, nl, mid, l, r, limit);
+        return found != NONE ? found : findBelow(2 * node + 1, mid, nr, l, r, limit);
+    }
+
+    // Last slot in [l, r) with value at or above limit, NONE if there is none
+    unsigned findLastAtLeast(unsigned node, unsigned nl, unsigned nr, unsigned l, unsigned r, unsigned limit) {
+        if (r <= nl || nr <= l || max_[node] < limit) return NONE;
+        if (nr - nl == 1) return nl;
+        push(node, nr - nl);
+        const unsigned mid = (nl + nr) / 2;
+        const unsigned found = findLastAtLeast(2 * node + 1, mid, nr, l, r, limit);
+        return found != NONE ? found : findLastAtLeast(2 * node, nl, mid, l, r, limit);
+    }
+
+    unsigned max(unsigned node, unsigned nl, unsigned nr, unsigned l, unsigned r) {
+        if (r <= nl || nr <= l) return 0;
+        if (l <= nl && nr <= r) return max_[node];
+        push(node, nr - nl);
+        const unsigned mid = (nl + nr) / 2;
+        return std::max(max(2 * node, nl, mid, l, r), max(2 * node + 1, mid, nr, l, r));
+    }
+
+    uint64_t sum(unsigned node, unsigned nl, unsigned nr, unsigned l, unsigned r) {
+        if (r <= nl || nr <= l) return 0;
+        if (l <= nl && nr <= r) return sum_[node];
+        push(node, nr - nl);
+        const unsigned mid = (nl + nr) / 2;
+        return sum(2 * node, nl, mid, l, r) + sum(2 * node + 1, mid, nr, l, r);
+    }
+
+    unsigned assign(unsigned node, unsigned nl, unsigned nr, unsigned slot, unsigned val) {
+        if (nr - nl == 1) {
+            const unsigned old = min_[node];
+            min_[node] = val;
+            max_[node] = val;
+            sum_[node] = val;
+            return old;
+        }
+        push(node, nr - nl);
+        const unsigned mid = (nl + nr) / 2;
+        const unsigned old = slot < mid ? assign(2 * node, nl, mid, slot, val)
+                                        : assign(2 * node + 1, mid, nr, slot, val);
+        pull(node);
+        return old;
+    }
+
+    unsigned slot(unsigned sf) const { return sf & (size_ - 1); }
+
+    // Calls fn(slot_begin, slot_end, sf_begin) for the (at most two) ring spans covering [from, to)
+    template <typename Fn>
+    void forSpans(unsigned from, unsigned to, Fn fn) {
+        while (from < to) {
+            const unsigned begin = slot(from);
+            const unsigned len = std::min(to - from, size_ - begin);
+            if (fn(begin, begin + len, from)) return;
+            from += len;
+        }
+    }
+
+  public:
+    IndexedWindow(unsigned window_len, unsigned rb_per_sf)
+      : rb_per_sf_(rb_per_sf),
+        size_(ringSize(window_len)),
+        min_(2 * size_),
+        max_(2 * size_),
+        sum_(2 * size_),
+        lazy_(2 * size_) {
+    }
+
+    unsigned load(unsigned sf) const {
+        // leaf value plus pending adds of its ancestors
+        unsigned node = size_ + slot(sf);
+        unsigned blocks = min_[node];
+        for (node /= 2; node > 0; node /= 2) blocks += lazy_[node];
+        return blocks;
+    }
+
+    unsigned retire(unsigned sf) {
+        return assign(1, 0, size_, slot(sf), 0);
+    }
+
+    // First subframe in [from, to) with a free resource block, to if none
+    unsigned findFree(unsigned from, unsigned to) {
+        unsigned found = to;
+        forSpans(from, to, [&](unsigned l, unsigned r, unsigned sf) {
+            const unsigned s = findBelow(1, 0, size_, l, r, rb_per_sf_);
+            if (s != NONE) found = sf + (s - l);
+            return s != NONE;
+        });
+        return found;
+    }
+
+    void add(unsigned from, unsigned to, int val) {
+        forSpans(from, to, [&](unsigned l, unsigned r, unsigned) {
+            add(1, 0, size_, l, r, val);
+            return false;
+        });
+    }
+
+    unsigned reserve(unsigned from, unsigned to, unsigned data_len, unsigned num, Allocation* out) {
+        unsigned num_reserved;
+        unsigned first = from;
+        for(num_reserved = 0; num_reserved < num; num_reserved++) {
+            first = findFree(first, to);
+            if(first + data_len > to) break;
+            add(first, first + data_len, 1);
+            if (out) out[num_reserved] = {first, Allocation::NO_RB};
+        }
+        return num_reserved;
+    }
+
+    unsigned findFit(unsigned from, unsigned to, unsigned len) {
+        unsigned sf = from;
+        while (sf + len <= to) {
+            // restart past the last full subframe of the candidate run
+            unsigned full = NONE;
+            forSpans(sf, sf + len, [&](unsigned l, unsigned r, unsigned span_sf) {
+                const unsigned s = findLastAtLeast(1, 0, size_, l, r, rb_per_sf_);
+                if (s != NONE) full = span_sf + (s - l);
+                return false;
+            });
+            if (full == NONE) return sf;
+            sf = full + 1;
+        }
+        return to;
+    }
+
+    unsigned runCapacity(unsigned sf, unsigned len) {
+        unsigned max_load = 0;
+        forSpans(sf, sf + len, [&](unsigned l, unsigned r, unsigned) {
+            max_load = std::max(max_load, max(1, 0, size_, l, r));
+            return false;
+        });
+        return max_load < rb_per_sf_ ? rb_per_sf_ - max_load : 0;
+    }
+
+    Allocation place(unsigned sf, unsigned len) {
+        add(sf, sf + len, 1);
+        return {sf, Allocation::NO_RB};
+    }
+
+    void adjust(const Allocation&, unsigned from, unsigned to, int delta) {
+        add(from, to, delta);
+    }
+
+    bool extendable(const Allocation&, unsigned from, unsigned to) {
+        return from == to || runCapacity(from, to - from) > 0;
+    }
+
+    uint64_t sum(unsigned from, unsigned to) {
+        uint64_t blocks = 0;
+        forSpans(from, to, [&](unsigned l, unsigned r, unsigned) {
+            blocks += sum(1, 0, size_, l, r);
+            return false;
+        });
+        return blocks;
+    }
+};
@@ -8,95 +8,207 @@
 
 #include <iostream>
 
-#include "scheduler.h"
+#include "cell.h"
+#include "shard.h"
+#include "pipeline.h"
+#include "scheduler_profiles.h"
 #include "../common.h"
+#include "../shm_transport.h"
 
-int main() {
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+template <typename Sched>
+void report(const Configuration& cfg, std::vector<Cell<Sched>>& cells) {
+    async_log.flush();
+    if (cfg.DEBUGPRINTS) {
+        /* Print num of reserved blocks in each subframe,
+         * reservation window of last subframe is in square brackets
+         */
+        for (auto& cell : cells) {
+            if (cells.size() > 1) std::cout << "Cell " << cell.id() << "\n";
+            std::cout << "Reserved blocks in UL subframes:\n";
+            cell.uplink.printWindow(cfg.SIMULATION_PERIOD_SF - 1, cfg.K);
+            std::cout << "Reserved blocks in DL subframes:\n";
+            cell.downlink.printWindow(cfg.SIMULATION_PERIOD_SF - 1, cfg.K);
+        }
+    }
+    // Totals over all cells, throughput and utilization per cell
+    unsigned success = 0;
+    unsigned total = 0;
+    double ul_blk_per_sf = 0;
+    double dl_blk_per_sf = 0;
+    decltype(Sched::packing_stats) packing_stats{};
+    std::vector<const UeTable*> ul_ue_tables;
+    std::vector<const UeTable*> dl_ue_tables;
+    for (auto& cell : cells) {
+        ul_ue_tables.push_back(&cell.ul_ue_table);
+        dl_ue_tables.push_back(&cell.dl_ue_table);
+        success += cell.uplink.success + cell.downlink.success;
+        total += cell.uplink.total + cell.downlink.total;
+        ul_blk_per_sf += cell.uplink.avgBlockPerSf(0, cfg.SIMULATION_PERIOD_SF - 1) / cells.size();
+        dl_blk_per_sf += cell.downlink.avgBlockPerSf(0, cfg.SIMULATION_PERIOD_SF - 1) / cells.size();
+        for (unsigned p = 0; p < std::size(packing_stats); p++) {
+            for (const auto* stats : {&cell.uplink.packing_stats[p], &cell.downlink.packing_stats[p]}) {
+                packing_stats[p].requests += stats->requests;
+                packing_stats[p].granted += stats->granted;
+                packing_stats[p].requested_blocks += stats->requested_blocks;
+                packing_stats[p].granted_blocks += stats->granted_blocks;
+            }
+        }
+    }
+    const double success_rate = 100.0 * success / std::max(1U, total);
+    if (cells.size() > 1) std::cout << "\nCells: " << cells.size();
+    std::cout << "\nSuccess rate: " << success_rate << "%\n";
+    // Throughput calculation assumes 1000 sf/sec regardless of SF_TIME_SCALE value.
+    std::cout << "Uplink throughput: " << 1000.0 * ul_blk_per_sf << " bytes/sec\n";
+    std::cout << "Downlink throughput: " << 1000.0 * dl_blk_per_sf << " bytes/sec\n";
+    std::cout << "Uplink utilization: " << 100.0 * ul_blk_per_sf / cfg.N << " %\n";
+    std::cout << "Downlink utilization: " << 100.0 * dl_blk_per_sf / cfg.N << " %\n";
+    std::cout << cfg.SCHEDULING_POLICY << ": Jain fairness of granted blocks " << jainFairness(ul_ue_tables)
+              << " uplink, " << jainFairness(dl_ue_tables) << " downlink\n";
+    for (unsigned p = 0; p < std::size(packing_stats); p++) {
+        const auto& stats = packing_stats[p];
+        if (stats.requests == 0) continue;
+        std::cout << static_cast<PackingPolicy>(p) << ": granted " << 100.0 * stats.granted / stats.requests
+                  << "% of requests, " << 100.0 * stats.granted_blocks / stats.requested_blocks
+                  << "% of requested blocks\n";
+    }
+}
 
-    if (sockfd < 0) {
-        perror("socket creation failed");
-        exit(EXIT_FAILURE);
+// Single cell served over the shared-memory rings, requests and responses stay in place
+template <typename Sched>
+void runScheduler(const Configuration& cfg, ShmTransport& link, std::vector<ServerMetrics>& metrics) {
+    std::vector<Cell<Sched>> cells;
+    cells.emplace_back(cfg, 0, metrics.front());
+    for (unsigned sf = 0; sf < cfg.SIMULATION_PERIOD_SF; sf++) {
+        const uint64_t wait_start = monotonicNs();
+        const Span<const ResourceRequest> aggregated_reqests = link.receive();
+        metrics.front().receive_wait.recordSince(wait_start);
+        if (aggregated_reqests.empty()) {
+            cells.front().schedule(aggregated_reqests, nullptr);
+            link.skip();
+            continue;
+        }
+        const unsigned num_responses = cells.front().schedule(aggregated_reqests, link.responseBuffer());
+        const uint64_t send_start = monotonicNs();
+        link.respond(num_responses);
+        metrics.front().send.recordSince(send_start);
     }
+    report(cfg, cells);
+}
 
-    struct sockaddr_in servaddr{};
-    servaddr.sin_family = AF_INET;
-    servaddr.sin_addr.s_addr = INADDR_ANY;
-    servaddr.sin_port = htons(PORT);
+template <typename Sched>
+ShardTiming runShardOrPipeline(const Configuration& cfg, int sockfd, std::vector<Cell<Sched>>& cells, unsigned shards, unsigned shard,
+                               ServerMetrics& metrics) {
+    if (cfg.PIPELINE) {
+        ShardPipeline<Sched> pipeline(cfg, sockfd, cells, shards, metrics);
+        return pipeline.run(shard * PIPELINE_STAGES);
+    }
+    if (shards > 1) pinToCore(shard);
+    return runShard(cfg, sockfd, cells, shards, metrics);
+}
 
-    if(bind(sockfd, reinterpret_cast<const struct sockaddr *>(&servaddr), sizeof(servaddr)) < 0 ) {
-        perror("bind failed");
-        exit(EXIT_FAILURE);
+// Cells are spread over one worker (or pipeline) per socket, see shard.h; metrics holds one per socket
+template <typename Sched>
+void runScheduler(const Configuration& cfg, const std::vector<int>& sockets, std::vector<ServerMetrics>& metrics) {
+    const unsigned shards = sockets.size();
+    std::vector<std::vector<Cell<Sched>>> shard_cells(shards);
+    for (uint32_t id = 0; id < cfg.CELLS; id++) shard_cells[id % shards].emplace_back(cfg, id, metrics[id % shards]);
+
+    std::vector<ShardTiming> timings(shards);
+    if (shards == 1) {
+        timings[0] = runShardOrPipeline(cfg, sockets[0], shard_cells[0], 1, 0, metrics[0]);
+    } else {
+        std::vector<std::thread> workers;
+        for (unsigned w = 0; w < shards; w++) {
+            workers.emplace_back([&, w]() {
+                timings[w] = runShardOrPipeline(cfg, sockets[w], shard_cells[w], shards, w, metrics[w]);
+            });
+        }
+        for (auto& worker : workers) worker.join();
     }
-    Scheduler schUplink(cfg.SIMULATION_PERIOD_SF, cfg.K, cfg.N);
-    Scheduler schDownlink(cfg.SIMULATION_PERIOD_SF, cfg.K, cfg.N);
 
-    unsigned current_sf;
-    for (current_sf = 0; current_sf < cfg.SIMULATION_PERIOD_SF; current_sf++) {
-        if (cfg.DEBUGPRINTS) std::cout << "subframe " << current_sf << "\n";
+    std::vector<Cell<Sched>> cells;
+    for (uint32_t id = 0; id < cfg.CELLS; id++) cells.push_back(std::move(shard_cells[id % shards][id / shards]));
+    report(cfg, cells);
 
-        std::vector<ResourceRequest> aggregated_reqests;
-        socklen_t len = sizeof(servaddr);
-        SockRecv(sockfd, servaddr, len, aggregated_reqests);
-        if(aggregated_reqests.empty()) continue;
+    // From the first batch any shard received to the last one answered
+    auto first = timings[0].first;
+    auto last = timings[0].last;
+    for (const auto& timing : timings) {
+        first = std::min(first, timing.first);
+        last = std::max(last, timing.last);
+    }
+    const double seconds = std::chrono::duration<double>(last - first).count();
+    std::cout << "Shards: " << shards << ", " << uint64_t{cfg.CELLS} * cfg.SIMULATION_PERIOD_SF / seconds
+              << " cell subframes/sec\n";
+}
 
-        unsigned ul_requests = 0;
-        unsigned dl_requests = 0;
-        for (auto req : aggregated_reqests) {
-            if (cfg.DEBUGPRINTS) {
-                std::cout << "Request from " << req.ue_id << " for " << req.data_length << " blocks in " << req.resource_type << "\n";
-            }
-            if (req.resource_type == ResourceType::UL) {
-                ul_requests++;
-            } else if (req.resource_type == ResourceType::DL) {
-                dl_requests++;
-            } else {
-                std::cerr << "Invalid resource_type requested\n";
-            }
+template <typename Transport>
+void runEngine(const Configuration& cfg, Transport& link, std::vector<ServerMetrics>& metrics) {
+    switch (cfg.SCHEDULER_ENGINE) {
+    case SchedulerEngine::LINEAR:
+        if (hasSchedulerProfile(cfg)) std::cout << "Scheduler kernels specialised for L=" << cfg.L << " N=" << cfg.N << " K=" << cfg.K << "\n";
+        withLinearScheduler(cfg, [&](auto sched) { runScheduler<typename decltype(sched)::type>(cfg, link, metrics); });
+        break;
+    case SchedulerEngine::INDEXED:
+        runScheduler<IndexedScheduler>(cfg, link, metrics);
+        break;
+    case SchedulerEngine::BITMAP:
+        runScheduler<BitmapScheduler>(cfg, link, metrics);
+        break;
+    }
+}
 
-        }
+// Sum of the shards' metrics
+void dumpServerMetrics(const std::vector<ServerMetrics>& metrics) {
+    ServerMetrics total;
+    for (const auto& shard : metrics) total.merge(shard);
+    dumpMetrics(std::cout, total.all(), total.counters());
+}
 
-        unsigned ul_allocated_count = schUplink.reserve(current_sf, cfg.L, ul_requests);
-        unsigned dl_allocated_count = schDownlink.reserve(current_sf, cfg.L, dl_requests);
-        if (cfg.DEBUGPRINTS) {
-            if (ul_requests) std::cout << "UL: allocated " << ul_allocated_count << " of requested " << ul_requests << "\n";
-            if (dl_requests) std::cout << "DL: allocated " << dl_allocated_count << " of requested " << dl_requests << "\n";
+int main() {
+    const Configuration cfg = Configuration::load();
+    static std::vector<ServerMetrics> metrics(cfg.TRANSPORT == TransportType::SHM ? 1 : shardCount(cfg));
+    onSignal([]() { dumpServerMetrics(metrics); });
+    if (!cfg.TRACE_RECORD.empty()) {
+        try {
+            trace_writer.open(cfg.TRACE_RECORD);
+        } catch (const std::system_error& e) {
+            std::cerr << e.what() << '\n';
+            exit(EXIT_FAILURE);
         }
-
-        std::vector<SchedulerResponse> scheduler_response;
-        for (auto req : aggregated_reqests) {
-            assert(req.data_length == cfg.L);
-            AllocationStatus status = AllocationStatus::FAIL;
-            if (req.resource_type == ResourceType::UL && ul_allocated_count > 0) {
-                ul_allocated_count--;
-                status = AllocationStatus::SUCCESS;
-            } else if (req.resource_type == ResourceType::DL && dl_allocated_count > 0) {
-                dl_allocated_count--;
-                status = AllocationStatus::SUCCESS;
-            }
-            scheduler_response.push_back({req.ue_id, status});
+    }
+    if (cfg.TRANSPORT == TransportType::SHM) {
+        if (cfg.CELLS != 1) {
+            std::cerr << "SHM transport supports a single cell\n";
+            exit(EXIT_FAILURE);
         }
-
-        SockSend(sockfd, servaddr, len, scheduler_response);
+        try {
+            ShmTransport link(ShmRole::SERVER, cfg.M);
+            runEngine(cfg, link, metrics);
+            trace_writer.close();
+            dumpServerMetrics(metrics);
+        } catch (const std::exception& e) {
+            std::cerr << "shared memory transport failed: " << e.what() << '\n';
+            exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
     }
-    if (cfg.DEBUGPRINTS) {
-        /* Print num of reserved blocks in each subframe,
-         * reservation window of last subframe is in square brackets
-         */
-        std::cout << "Reserved blocks in UL subframes:\n";
-        schUplink.printWindow(cfg.SIMULATION_PERIOD_SF - 1, cfg.K);
-        std::cout << "Reserved blocks in DL subframes:\n";
-        schDownlink.printWindow(cfg.SIMULATION_PERIOD_SF - 1, cfg.K);
+
+    struct sockaddr_in servaddr{};
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = INADDR_ANY;
+    servaddr.sin_port = htons(PORT);
+
+    std::vector<int> sockets;
+    try {
+        sockets = openShardSockets(servaddr, shardCount(cfg));
+    } catch (const std::system_error& e) {
+        std::cerr << e.what() << '\n';
+        exit(EXIT_FAILURE);
     }
-    const double success_rate = 100.0 * (schUplink.success + schDownlink.success) / (schUplink.total + schDownlink.total);
-    const double ul_blk_per_sf = schUplink.avgBlockPerSf(0, cfg.SIMULATION_PERIOD_SF - 1);
-    const double dl_blk_per_sf = schUplink.avgBlockPerSf(0, cfg.SIMULATION_PERIOD_SF - 1);
-    std::cout << "\nSuccess rate: " << success_rate << "%\n";
-    // Throughput calculation assumes 1000 sf/sec regardless of SF_TIME_SCALE value.
-    std::cout << "Uplink throughput: " << 1000.0 * ul_blk_per_sf << " bytes/sec\n";
-    std::cout << "Downlink throughput: " << 1000.0 * dl_blk_per_sf << " bytes/sec\n";
-    std::cout << "Uplink utilization: " << 100.0 * ul_blk_per_sf / cfg.N << " %\n";
-    std::cout << "Downlink utilization: " << 100.0 * dl_blk_per_sf / cfg.N << " %\n";
-    close(sockfd);
+    runEngine(cfg, sockets, metrics);
+    trace_writer.close();
+    dumpServerMetrics(metrics);
+    for (const int sockfd : sockets) close(sockfd);
     exit(EXIT_SUCCESS);
 }
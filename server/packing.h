@@ -0,0 +1,75 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "window.h"
+#include "../common.h"
+
+/* Packing of a batch of runs with different lengths into the window [from, to).
+ * Runs are tried one by one in order (arrival order if empty), each either
+ * fits entirely or is rejected:
+ *   FIRST_FIT     - earliest subframe the run fits at
+ *   BEST_FIT      - the fitting subframe with the fewest runs left after
+ *                   placement (tightest spot), earliest on ties
+ *   LONGEST_FIRST - first fit, longest runs first, order breaks ties
+ * out[i] receives the placement of lengths[i], NO_SUBFRAME if it did not fit.
+ * Once a run is rejected no longer one can fit, so those are not searched.
+ * sorted is the caller's scratch space for the order runs are tried in, kept
+ * between calls so that a batch allocates nothing once it has grown.
+ */
+template <typename Window>
+unsigned packFirstFit(Window& window, unsigned from, unsigned to, unsigned len, Allocation& out) {
+    const unsigned sf = window.findFit(from, to, len);
+    if (sf + len > to) return 0;
+    out = window.place(sf, len);
+    return 1;
+}
+
+template <typename Window>
+unsigned packBestFit(Window& window, unsigned from, unsigned to, unsigned len, Allocation& out) {
+    unsigned best_sf = to;
+    unsigned best_capacity = ~0U;
+    for (unsigned sf = window.findFit(from, to, len); sf + len <= to; sf = window.findFit(sf + 1, to, len)) {
+        const unsigned capacity = window.runCapacity(sf, len);
+        if (capacity < best_capacity) {
+            best_capacity = capacity;
+            best_sf = sf;
+            if (capacity == 1) break;
+        }
+    }
+    if (best_sf == to) return 0;
+    out = window.place(best_sf, len);
+    return 1;
+}
+
+template <typename Window>
+unsigned pack(Window& window, unsigned from, unsigned to, const std::vector<unsigned>& lengths,
+              PackingPolicy policy, std::vector<Allocation>& out, const std::vector<unsigned>& order, std::vector<unsigned>& sorted) {
+    out.assign(lengths.size(), {Allocation::NO_SUBFRAME, Allocation::NO_RB});
+    sorted.assign(order.cbegin(), order.cend());
+    if (sorted.empty()) {
+        sorted.resize(lengths.size());
+        std::iota(sorted.begin(), sorted.end(), 0);
+    }
+    if (policy == PackingPolicy::LONGEST_FIRST) {
+        std::stable_sort(sorted.begin(), sorted.end(), [&](unsigned a, unsigned b) { return lengths[a] > lengths[b]; });
+    }
+    unsigned num_reserved = 0;
+    unsigned rejected_len = ~0U;    // shortest run rejected so far
+    for (const unsigned i : sorted) {
+        if (lengths[i] >= rejected_len) continue;
+        const unsigned placed = policy == PackingPolicy::BEST_FIT ? packBestFit(window, from, to, lengths[i], out[i])
+                                                                  : packFirstFit(window, from, to, lengths[i], out[i]);
+        if (!placed) rejected_len = lengths[i];
+        num_reserved += placed;
+    }
+    return num_reserved;
+}
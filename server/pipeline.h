@@ -0,0 +1,200 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <thread>
+#include <vector>
+
+#include "shard.h"
+#include "../lockfree_ring.h"
+
+/* Pipelined shard: four stages on their own cores, connected by SPSC rings
+ * of job slot indices.
+ *
+ *   RX  waits for frames and subframe ticks (ShardEvents), reassembles batches
+ *       into free slots and decodes them (Cell::decode)
+ *   UL  runs the uplink scheduler of every batch
+ *   DL  runs the downlink scheduler of every batch
+ *   TX  encodes the responses once UL and DL are done, frees the slots and sends the frames
+ *
+ * Slots are preallocated and used in ring order, so RX can receive subframe
+ * n + 1 while n is being scheduled and nothing is allocated per subframe.
+ */
+constexpr unsigned PIPELINE_STAGES = 4;
+constexpr unsigned PIPELINE_SLOTS = 2 * UDP_WINDOW;
+
+template <typename Sched>
+class ShardPipeline {
+    static constexpr unsigned STOP = ~0U;           // slot index ending the downstream stages
+
+    struct Job {
+        uint32_t cell = 0;                          // index in cells_
+        uint32_t subframe = 0;
+        bool late = false;                          // missed its deadline, every request fails
+        struct sockaddr_in from{};
+        std::vector<ResourceRequest> requests{};
+        std::vector<SchedulerResponse> responses{};
+        CellBatch batch{};
+    };
+
+    const Configuration& cfg_;
+    int sockfd_;
+    std::vector<Cell<Sched>>& cells_;
+    ServerMetrics& metrics_;
+    CellDatagrams requests_;
+    CellDatagrams responses_;
+    ShardInbox<Sched> inbox_;
+    std::vector<Job> jobs_;
+    SpscChannel<unsigned> to_ul_;
+    SpscChannel<unsigned> to_dl_;
+    SpscChannel<unsigned> ul_done_;
+    SpscChannel<unsigned> dl_done_;
+    SpscChannel<unsigned> free_;
+    ShardTiming timing_{};
+
+    // Every datagram completes at most one batch, so RX receives no more of them than it has free slots
+    void receive() {
+        ShardEvents events(cfg_, sockfd_);
+        unsigned credits = PIPELINE_SLOTS;
+        unsigned next = 0;
+        uint32_t socket_drops = 0;
+        while (!inbox_.done()) {
+            const uint64_t wait_start = monotonicNs();
+            uint64_t ticks;
+            bool readable;
+            if (!events.wait(ticks, readable)) break;
+            metrics_.receive_wait.recordSince(wait_start);
+            inbox_.tick(ticks);
+            for (unsigned count = 0, received = 0; readable && received == count; ) {
+                unsigned slot;
+                while (free_.tryPop(slot)) credits++;
+                if (!credits) {
+                    metrics_.rx_stalls.add();
+                    free_.pop(slot);
+                    credits++;
+                }
+                count = std::min(credits, requests_.slots());
+                received = requests_.receive(sockfd_, count, MSG_DONTWAIT);
+                if (received == requests_.slots()) metrics_.full_receives.add();
+                if (received && events.received()) timing_.first = std::chrono::steady_clock::now();
+                for (unsigned i = 0; i < received; i++) {
+                    const uint32_t index = inbox_.add(requests_.data(i), requests_.length(i));
+                    if (index == ShardInbox<Sched>::NO_CELL) continue;
+                    Job& job = jobs_[next];
+                    job.cell = index;
+                    job.subframe = inbox_.batch(index).subframe();
+                    job.late = inbox_.late(index);
+                    job.from = requests_.address(i);
+                    inbox_.batch(index).take(job.requests);
+                    if (!job.late) cells_[index].decode(job.subframe, {job.requests.data(), job.requests.size()}, job.batch);
+                    to_ul_.tryPush(next);
+                    to_dl_.tryPush(next);
+                    credits--;
+                    next = (next + 1) % PIPELINE_SLOTS;
+                }
+            }
+            metrics_.socket_drops.add(requests_.socketDrops() - socket_drops);
+            socket_drops = requests_.socketDrops();
+        }
+        inbox_.closeBefore(cfg_.SIMULATION_PERIOD_SF);
+        to_ul_.tryPush(STOP);
+        to_dl_.tryPush(STOP);
+    }
+
+    template <typename Schedule>
+    void schedule(SpscChannel<unsigned>& in, SpscChannel<unsigned>& done, Schedule schedule_direction) {
+        unsigned slot;
+        while (in.pop(slot) && slot != STOP) {
+            Job& job = jobs_[slot];
+            if (!job.late) schedule_direction(cells_[job.cell], job.batch);
+            done.tryPush(slot);
+        }
+        done.tryPush(STOP);
+    }
+
+    void flush() {
+        const uint64_t send_start = monotonicNs();
+        responses_.flush(sockfd_);
+        metrics_.send.recordSince(send_start);
+    }
+
+    // Encoded responses no longer need their slot, it goes back to RX before the frames are sent
+    void transmit() {
+        while (true) {
+            unsigned slot;
+            unsigned dl_slot;
+            if (!ul_done_.tryPop(slot)) {
+                // send what is ready before waiting for more
+                flush();
+                ul_done_.pop(slot);
+            }
+            dl_done_.pop(dl_slot);
+            if (slot == STOP) break;
+            Job& job = jobs_[slot];
+            const Span<const ResourceRequest> requests{job.requests.data(), job.requests.size()};
+            if (job.responses.size() < requests.size()) job.responses.resize(requests.size());
+            const unsigned num_responses = job.late ? cells_[job.cell].reject(requests, job.responses.data())
+                                                    : cells_[job.cell].respond(requests, job.batch, job.responses.data());
+            responses_.queue(sockfd_, cells_[job.cell].id(), job.subframe,
+                             Span<const SchedulerResponse>{job.responses.data(), num_responses}, job.from);
+            free_.tryPush(slot);
+        }
+        flush();
+        timing_.last = std::chrono::steady_clock::now();
+    }
+
+  public:
+    ShardPipeline(const Configuration& cfg, int sockfd, std::vector<Cell<Sched>>& cells, unsigned shards, ServerMetrics& metrics)
+      : cfg_(cfg),
+        sockfd_(sockfd),
+        cells_(cells),
+        metrics_(metrics),
+        requests_(UDP_WINDOW),
+        responses_(UDP_WINDOW),
+        inbox_(cfg, cells, shards, metrics),
+        jobs_(PIPELINE_SLOTS),
+        to_ul_(PIPELINE_SLOTS + 1),
+        to_dl_(PIPELINE_SLOTS + 1),
+        ul_done_(PIPELINE_SLOTS + 1),
+        dl_done_(PIPELINE_SLOTS + 1),
+        free_(PIPELINE_SLOTS) {
+        for (auto& job : jobs_) {
+            job.requests.reserve(cfg.M);
+            job.responses.resize(cfg.M);
+            job.batch.ul_lengths.reserve(cfg.M);
+            job.batch.dl_lengths.reserve(cfg.M);
+            job.batch.ul_ues.reserve(cfg.M);
+            job.batch.dl_ues.reserve(cfg.M);
+            job.batch.ul_order.reserve(cfg.M);
+            job.batch.dl_order.reserve(cfg.M);
+            job.batch.ul_allocations.reserve(cfg.M);
+            job.batch.dl_allocations.reserve(cfg.M);
+        }
+    }
+
+    // Runs RX on the calling thread, every stage is pinned to a core from first_core on
+    ShardTiming run(unsigned first_core) {
+        std::thread ul([this, first_core]() {
+            pinToCore(first_core + 1);
+            schedule(to_ul_, ul_done_, [](Cell<Sched>& cell, CellBatch& batch) { cell.scheduleUplink(batch); });
+        });
+        std::thread dl([this, first_core]() {
+            pinToCore(first_core + 2);
+            schedule(to_dl_, dl_done_, [](Cell<Sched>& cell, CellBatch& batch) { cell.scheduleDownlink(batch); });
+        });
+        std::thread tx([this, first_core]() {
+            pinToCore(first_core + 3);
+            transmit();
+        });
+        pinToCore(first_core);
+        receive();
+        ul.join();
+        dl.join();
+        tx.join();
+        return timing_;
+    }
+};
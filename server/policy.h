@@ -0,0 +1,126 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "window.h"
+#include "../common.h"
+
+/* Per-UE state of one cell and direction, one array per field so ranking a
+ * batch only touches what its policy reads. UEs are numbered 0..M-1 in the cell.
+ *
+ * There is no channel model, so the rate a UE would get from a grant is the
+ * length of its request: MAX_THROUGHPUT serves the longest requests first and
+ * PROPORTIONAL_FAIR divides the length by the UE's average granted blocks per
+ * subframe. ROUND_ROBIN serves the UE whose last grant is oldest. Ties go to
+ * the UE rejected more often since its last grant, then to arrival order.
+ */
+class UeTable {
+    struct Rank {
+        double key;
+        unsigned retries;
+        unsigned index;     // in the batch
+
+        bool operator < (const Rank& other) const {
+            if (key != other.key) return key < other.key;
+            if (retries != other.retries) return retries < other.retries;
+            return index > other.index;
+        }
+    };
+
+    std::vector<double> avg_rate_;          // blocks granted per subframe, exponential average as of updated_sf_
+    std::vector<unsigned> updated_sf_;
+    std::vector<unsigned> last_grant_sf_;
+    std::vector<uint16_t> retries_;         // requests rejected since the last grant
+    std::vector<uint64_t> requests_;
+    std::vector<uint64_t> granted_blocks_;
+    std::vector<Rank> heap_{};
+
+    double avgRate(unsigned ue, unsigned sf) const {
+        return avg_rate_[ue] * std::pow(1.0 - 1.0 / RATE_WINDOW_SF, sf - updated_sf_[ue]);
+    }
+
+  public:
+    static constexpr double RATE_WINDOW_SF = 100;   // time constant of the average rate
+
+    explicit UeTable(unsigned num_ues)
+      : avg_rate_(num_ues),
+        updated_sf_(num_ues),
+        last_grant_sf_(num_ues),
+        retries_(num_ues),
+        requests_(num_ues),
+        granted_blocks_(num_ues) {
+    }
+
+    unsigned size() const { return avg_rate_.size(); }
+    uint64_t requests(unsigned ue) const { return requests_[ue]; }
+    uint64_t grantedBlocks(unsigned ue) const { return granted_blocks_[ue]; }
+
+    /* Fills order with the indices of the batch requests of ues in the order
+     * policy serves them, O(num log num) by popping a heap. FIFO leaves it empty.
+     */
+    void rank(SchedulingPolicy policy, unsigned sf, const std::vector<unsigned>& ues,
+              const std::vector<unsigned>& lengths, std::vector<unsigned>& order) {
+        order.clear();
+        if (policy == SchedulingPolicy::FIFO) return;
+        heap_.clear();
+        for (unsigned i = 0; i < ues.size(); i++) {
+            const unsigned ue = ues[i];
+            double key = lengths[i];
+            if (policy == SchedulingPolicy::ROUND_ROBIN) {
+                key = sf - last_grant_sf_[ue];
+            } else if (policy == SchedulingPolicy::PROPORTIONAL_FAIR) {
+                key = lengths[i] / (avgRate(ue, sf) + 1.0 / RATE_WINDOW_SF);
+            }
+            heap_.push_back({key, retries_[ue], i});
+        }
+        std::make_heap(heap_.begin(), heap_.end());
+        for (auto end = heap_.end(); end != heap_.begin(); --end) {
+            std::pop_heap(heap_.begin(), end);
+            order.push_back((end - 1)->index);
+        }
+    }
+
+    // Records the outcome of a batch ranked at subframe sf
+    void update(unsigned sf, const std::vector<unsigned>& ues, const std::vector<unsigned>& lengths,
+                const std::vector<Allocation>& allocations) {
+        for (unsigned i = 0; i < ues.size(); i++) {
+            const unsigned ue = ues[i];
+            requests_[ue]++;
+            if (allocations[i].subframe == Allocation::NO_SUBFRAME) {
+                if (retries_[ue] < UINT16_MAX) retries_[ue]++;
+                continue;
+            }
+            avg_rate_[ue] = avgRate(ue, sf) + lengths[i] / RATE_WINDOW_SF;
+            updated_sf_[ue] = sf;
+            last_grant_sf_[ue] = sf;
+            retries_[ue] = 0;
+            granted_blocks_[ue] += lengths[i];
+        }
+    }
+};
+
+// Jain's index of the blocks granted to every UE that made a request, 1 when all got the same
+inline double jainFairness(const std::vector<const UeTable*>& tables) {
+    double sum = 0;
+    double sum_sq = 0;
+    unsigned ues = 0;
+    for (const auto* table : tables) {
+        for (unsigned ue = 0; ue < table->size(); ue++) {
+            if (table->requests(ue) == 0) continue;
+            const double blocks = table->grantedBlocks(ue);
+            sum += blocks;
+            sum_sq += blocks * blocks;
+            ues++;
+        }
+    }
+    return sum_sq > 0 ? sum * sum / (ues * sum_sq) : 1.0;
+}
@@ -0,0 +1,124 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include "window.h"
+
+// Names a reserved run until it is released or its last subframe retires
+struct ReservationHandle {
+    static constexpr uint32_t NONE = ~0U;
+    uint32_t slot = NONE;
+    uint32_t generation = 0;
+
+    bool valid() const { return slot != NONE; }
+};
+
+struct Reservation {
+    Allocation allocation;
+    unsigned len;
+};
+
+/* Reserved runs that have handles, in a pool of slots that is reused through
+ * a free list: once it has grown to the number of runs live at the same time,
+ * adding and removing runs allocates nothing. A slot's generation changes
+ * every time it is freed, so stale handles are recognised.
+ * Every run is also linked into the expiry bucket of its last subframe, a ring
+ * like the windows', and expire(sf) frees the runs ending in sf.
+ */
+class ReservationTable {
+    static constexpr uint32_t NONE = ReservationHandle::NONE;
+
+    struct Slot {
+        Reservation run;
+        uint32_t generation;
+        uint32_t prev;      // in the expiry bucket
+        uint32_t next;      // in the expiry bucket, or the free list
+    };
+
+    std::vector<Slot> slots_{};
+    std::vector<uint32_t> buckets_;     // first slot of the runs ending in each ring slot
+    uint32_t free_ = NONE;
+    unsigned live_ = 0;
+
+    uint32_t& bucket(unsigned sf) { return buckets_[sf & (buckets_.size() - 1)]; }
+
+    void link(uint32_t slot) {
+        Slot& s = slots_[slot];
+        uint32_t& head = bucket(s.run.allocation.subframe + s.run.len - 1);
+        s.prev = NONE;
+        s.next = head;
+        if (head != NONE) slots_[head].prev = slot;
+        head = slot;
+    }
+
+    void unlink(uint32_t slot) {
+        Slot& s = slots_[slot];
+        if (s.prev != NONE) slots_[s.prev].next = s.next;
+        else bucket(s.run.allocation.subframe + s.run.len - 1) = s.next;
+        if (s.next != NONE) slots_[s.next].prev = s.prev;
+    }
+
+    void free(uint32_t slot) {
+        Slot& s = slots_[slot];
+        s.generation++;
+        s.next = free_;
+        free_ = slot;
+        live_--;
+    }
+
+  public:
+    explicit ReservationTable(unsigned window_len) : buckets_(ringSize(window_len), NONE) {}
+
+    // Runs with a handle that were neither released nor expired
+    unsigned size() const { return live_; }
+
+    ReservationHandle add(const Reservation& run) {
+        uint32_t slot = free_;
+        if (slot != NONE) {
+            free_ = slots_[slot].next;
+        } else {
+            slot = slots_.size();
+            slots_.push_back({run, 0, NONE, NONE});
+        }
+        slots_[slot].run = run;
+        link(slot);
+        live_++;
+        return {slot, slots_[slot].generation};
+    }
+
+    // The run of handle, nullptr if it was released or has expired
+    const Reservation* find(ReservationHandle handle) const {
+        if (handle.slot >= slots_.size() || slots_[handle.slot].generation != handle.generation) return nullptr;
+        return &slots_[handle.slot].run;
+    }
+
+    // Replaces the run of a valid handle, which stays valid
+    void update(ReservationHandle handle, const Reservation& run) {
+        unlink(handle.slot);
+        slots_[handle.slot].run = run;
+        link(handle.slot);
+    }
+
+    void remove(ReservationHandle handle) {
+        unlink(handle.slot);
+        free(handle.slot);
+    }
+
+    // Frees every run whose last subframe is sf
+    void expire(unsigned sf) {
+        uint32_t& head = bucket(sf);
+        for (uint32_t slot = head; slot != NONE; ) {
+            const uint32_t next = slots_[slot].next;
+            free(slot);
+            slot = next;
+        }
+        head = NONE;
+    }
+};
@@ -11,55 +11,320 @@
 #include <algorithm>
 #include <iostream>
 #include <cassert>
+#include <cstdint>
 
-class Scheduler {
+#include "counter_window.h"
+#include "fenwick.h"
+#include "indexed_window.h"
+#include "bitmap_window.h"
+#include "packing.h"
+#include "reservations.h"
+
+/* Reservation state is kept in a circular window: only the K-subframe
+ * lookahead lives in memory (ring of power-of-two size >= K), subframes that
+ * fall behind current_sf are folded into a retired summary. Memory is O(K)
+ * regardless of simulation length. Window is the reservation engine holding
+ * the ring, see window.h.
+ *
+ * Block counts are kept up to date as runs are placed: a running total, a
+ * Fenwick tree over the live window and prefix sums of the last ring size
+ * retired subframes, so utilization over a range is O(log K) to query.
+ *
+ * Runs reserved with handles can be released, resized or moved while they
+ * are in the live window, see ReservationTable.
+ */
+template <typename Window>
+class BasicScheduler {
     unsigned window_len_;
     unsigned rb_per_sf_;
-    std::vector<unsigned> subframes;
+    Window window_;
+    unsigned window_begin_ = 0;      // first subframe still held in the ring
+    uint64_t retired_blocks_ = 0;    // sum of reserved blocks in [0, window_begin_)
+    uint64_t reserved_blocks_ = 0;   // sum of reserved blocks in all subframes
+    unsigned uniform_len_ = 0;       // length of every run reserved so far, MIXED_LEN once they differ
+    RingFenwick live_;               // blocks per live subframe
+    std::vector<uint64_t> retired_prefix_;  // blocks in [0, sf + 1) at the ring slot of retired sf
+    std::vector<Allocation> placed_{};      // placements of reserve() calls without out
+    std::vector<unsigned> pack_order_{};    // scratch of ::pack()
+    ReservationTable reservations_;
+
+    static constexpr unsigned MIXED_LEN = ~0U;
+
+    unsigned ringMask() const { return retired_prefix_.size() - 1; }
+
+    // Retire subframes preceding current_sf, reusing their ring slots.
+    void advance(unsigned current_sf) {
+        assert(current_sf >= window_begin_);
+        const unsigned live_end = std::min(current_sf, window_begin_ + window_len_);
+        for (unsigned sf = window_begin_; sf < live_end; sf++) {
+            const unsigned blocks = window_.retire(sf);
+            reservations_.expire(sf);
+            live_.add(sf, sf + 1, -static_cast<int64_t>(blocks));
+            retired_blocks_ += blocks;
+            retired_prefix_[sf & ringMask()] = retired_blocks_;
+        }
+        // subframes the window never reached had nothing reserved
+        for (unsigned sf = std::max(live_end, current_sf - std::min(current_sf, ringMask() + 1)); sf < current_sf; sf++) {
+            retired_prefix_[sf & ringMask()] = retired_blocks_;
+        }
+        window_begin_ = current_sf;
+    }
+
+    // Adds runs of len subframes starting at the granted placements to the counts
+    void count(const Allocation* placed, unsigned num, unsigned len) {
+        reserved_blocks_ += uint64_t{num} * len;
+        for (unsigned i = 0; i < num; ) {
+            unsigned same = i + 1;   // the linear engine returns runs sharing a subframe next to each other
+            while (same < num && placed[same].subframe == placed[i].subframe) same++;
+            live_.add(placed[i].subframe, placed[i].subframe + len, same - i);
+            i = same;
+        }
+    }
+
+    // Adds delta blocks of run to [from, to) of the live window
+    void change(const Allocation& run, unsigned from, unsigned to, int delta) {
+        window_.adjust(run, from, to, delta);
+        live_.add(from, to, delta);
+        reserved_blocks_ += static_cast<int64_t>(delta) * (to - from);
+        // first subframe free no longer means the whole run is, see reserve()
+        uniform_len_ = MIXED_LEN;
+    }
+
+    // Blocks reserved in [0, sf)
+    uint64_t blocksBefore(unsigned sf) const {
+        if (sf >= window_begin_ + window_len_) return reserved_blocks_;
+        if (sf > window_begin_) return retired_blocks_ + live_.sum(window_begin_, sf);
+        if (sf == window_begin_) return retired_blocks_;
+        if (sf == 0) return 0;
+        assert(window_begin_ - sf < ringMask() + 1);
+        return retired_prefix_[(sf - 1) & ringMask()];
+    }
 
   public:
+    // Outcome of requests handled by one packing policy
+    struct PackingStats {
+        unsigned requests = 0;
+        unsigned granted = 0;
+        uint64_t requested_blocks = 0;
+        uint64_t granted_blocks = 0;
+    };
+
     unsigned success = 0;
     unsigned total = 0;
-    Scheduler(unsigned simulation_len, unsigned window_len, unsigned rb_per_sf)
+    PackingStats packing_stats[3]{};   // indexed by PackingPolicy
+    BasicScheduler(unsigned window_len, unsigned rb_per_sf)
       : window_len_(window_len),
         rb_per_sf_(rb_per_sf),
-        subframes(simulation_len + window_len - 1) {
+        window_(window_len, rb_per_sf),
+        live_(ringSize(window_len)),
+        retired_prefix_(ringSize(window_len)),
+        reservations_(window_len) {
     }
 
-    unsigned reserve(unsigned current_sf, unsigned data_len, unsigned num) {
-        const auto window_begin = subframes.begin() + current_sf;
-        const auto window_end = window_begin + window_len_;
-
-        auto is_free = [this](unsigned n) { return n < rb_per_sf_; };
-        auto inc = [](unsigned& n) { n++; };
+    // simulation_len is no longer needed for storage, kept for existing callers
+    BasicScheduler(unsigned /*simulation_len*/, unsigned window_len, unsigned rb_per_sf)
+      : BasicScheduler(window_len, rb_per_sf) {
+    }
 
-        unsigned num_reserved;
-        auto first = window_begin;
-        for(num_reserved = 0; num_reserved < num; num_reserved++) {
-            first = std::find_if(first, window_end, is_free);
-            if(first + data_len > window_end) break;
-            std::for_each(first, first + data_len, inc);
+    /* Reserves up to num runs of data_len subframes, first-fit. If out is not
+     * null it receives the placement of each reserved run, in order.
+     * The engine's batched reserve() takes a free first subframe for a free
+     * run, which holds while every run had the same length and none was
+     * changed; otherwise the runs are placed one by one like pack() does.
+     */
+    unsigned reserve(unsigned current_sf, unsigned data_len, unsigned num, Allocation* out = nullptr) {
+        advance(current_sf);
+        if (num) uniform_len_ = uniform_len_ == 0 || uniform_len_ == data_len ? data_len : MIXED_LEN;
+        if (!out) {
+            if (placed_.size() < num) placed_.resize(num);
+            out = placed_.data();
         }
+        unsigned num_reserved = 0;
+        if (uniform_len_ == MIXED_LEN && data_len) {
+            for (Allocation placed{}; num_reserved < num && packFirstFit(window_, current_sf, current_sf + window_len_, data_len, placed); ) {
+                out[num_reserved++] = placed;
+            }
+        } else {
+            num_reserved = window_.reserve(current_sf, current_sf + window_len_, data_len, num, out);
+        }
+        count(out, num_reserved, data_len);
         total += num;
         success += num_reserved;
         return num_reserved;
     }
 
-    double avgBlockPerSf (unsigned from, unsigned len) {
-        const auto first = subframes.cbegin() + from;
-        assert(first + len <= subframes.cend());
-        return std::accumulate(first, first + len, 0.0) / len;
+    /* reserve() giving every reserved run a handle, handles must have room for
+     * num; rejected runs get handles that are not valid().
+     */
+    unsigned reserve(unsigned current_sf, unsigned data_len, unsigned num, Allocation* out, ReservationHandle* handles) {
+        if (!out) {
+            if (placed_.size() < num) placed_.resize(num);
+            out = placed_.data();
+        }
+        const unsigned num_reserved = reserve(current_sf, data_len, num, out);
+        for (unsigned i = 0; i < num; i++) {
+            handles[i] = i < num_reserved && data_len ? reservations_.add({out[i], data_len}) : ReservationHandle{};
+        }
+        return num_reserved;
+    }
+
+    /* Places a batch of runs with individual lengths using policy, see packing.h.
+     * Runs are tried in order, arrival order if it is empty. out[i] receives the
+     * placement of lengths[i], NO_SUBFRAME if it was rejected.
+     * While every run ever requested had the same length, first fit only needs
+     * the first subframe of a run to be free, so such batches go to reserve().
+     */
+    unsigned pack(unsigned current_sf, const std::vector<unsigned>& lengths, PackingPolicy policy,
+                  std::vector<Allocation>& out, const std::vector<unsigned>& order = {}) {
+        const bool uniform = std::all_of(lengths.cbegin(), lengths.cend(), [this, &lengths](unsigned len) {
+            return len == lengths.front() && (uniform_len_ == 0 || uniform_len_ == len);
+        });
+        advance(current_sf);
+        unsigned num_reserved;
+        if (uniform && policy != PackingPolicy::BEST_FIT) {
+            out.resize(lengths.size());
+            Allocation* placed = order.empty() ? out.data() : nullptr;
+            num_reserved = lengths.empty() ? 0 : reserve(current_sf, lengths.front(), lengths.size(), placed);
+            if (order.empty()) {
+                std::fill(out.begin() + num_reserved, out.end(), Allocation{Allocation::NO_SUBFRAME, Allocation::NO_RB});
+            } else {
+                // the runs are alike, the first num_reserved in order get the placements
+                for (unsigned i = 0; i < order.size(); i++) {
+                    out[order[i]] = i < num_reserved ? placed_[i] : Allocation{Allocation::NO_SUBFRAME, Allocation::NO_RB};
+                }
+            }
+        } else {
+            uniform_len_ = lengths.empty() ? uniform_len_ : MIXED_LEN;
+            num_reserved = ::pack(window_, current_sf, current_sf + window_len_, lengths, policy, out, order, pack_order_);
+            for (unsigned i = 0; i < lengths.size(); i++) {
+                if (out[i].subframe != Allocation::NO_SUBFRAME) count(&out[i], 1, lengths[i]);
+            }
+            total += lengths.size();
+            success += num_reserved;
+        }
+        PackingStats& stats = packing_stats[static_cast<unsigned>(policy)];
+        stats.requests += lengths.size();
+        stats.granted += num_reserved;
+        for (unsigned i = 0; i < lengths.size(); i++) {
+            stats.requested_blocks += lengths[i];
+            if (out[i].subframe != Allocation::NO_SUBFRAME) stats.granted_blocks += lengths[i];
+        }
+        return num_reserved;
+    }
+
+    // pack() giving every placed run a handle, rejected runs get handles that are not valid()
+    unsigned pack(unsigned current_sf, const std::vector<unsigned>& lengths, PackingPolicy policy,
+                  std::vector<Allocation>& out, const std::vector<unsigned>& order, std::vector<ReservationHandle>& handles) {
+        const unsigned num_reserved = pack(current_sf, lengths, policy, out, order);
+        handles.resize(lengths.size());
+        for (unsigned i = 0; i < lengths.size(); i++) {
+            const bool placed = out[i].subframe != Allocation::NO_SUBFRAME && lengths[i];
+            handles[i] = placed ? reservations_.add({out[i], lengths[i]}) : ReservationHandle{};
+        }
+        return num_reserved;
+    }
+
+    // The run of handle, nullptr once it was released or its last subframe retired
+    const Reservation* reservation(ReservationHandle handle) const { return reservations_.find(handle); }
+
+    // Runs with handles that are still live
+    unsigned reservations() const { return reservations_.size(); }
+
+    // Frees the run's blocks in subframes not retired yet; false if the handle is no longer valid
+    bool release(ReservationHandle handle) {
+        const Reservation* run = reservations_.find(handle);
+        if (!run) return false;
+        const unsigned first = run->allocation.subframe;
+        change(run->allocation, std::max(first, window_begin_), first + run->len, -1);
+        reservations_.remove(handle);
+        return true;
+    }
+
+    /* Changes the length of a run. It can shrink as long as its last subframe is
+     * not retired and grow into free blocks of the live window; false if not.
+     */
+    bool resize(ReservationHandle handle, unsigned len) {
+        const Reservation* run = reservations_.find(handle);
+        if (!run || len == 0) return false;
+        const Allocation allocation = run->allocation;
+        const unsigned end = allocation.subframe + run->len;
+        const unsigned new_end = allocation.subframe + len;
+        if (new_end < end) {
+            if (new_end <= window_begin_) return false;
+            change(allocation, new_end, end, -1);
+        } else if (new_end > end) {
+            if (new_end > window_begin_ + window_len_ || !window_.extendable(allocation, end, new_end)) return false;
+            change(allocation, end, new_end, 1);
+        }
+        reservations_.update(handle, {allocation, len});
+        return true;
+    }
+
+    /* Moves a run that has not started yet to start at sf of the live window.
+     * The run may land on another resource block; false if it does not fit.
+     */
+    bool move(ReservationHandle handle, unsigned sf) {
+        const Reservation* found = reservations_.find(handle);
+        if (!found || found->allocation.subframe < window_begin_) return false;
+        const Reservation run = *found;
+        if (sf < window_begin_ || sf + run.len > window_begin_ + window_len_) return false;
+        change(run.allocation, run.allocation.subframe, run.allocation.subframe + run.len, -1);
+        if (window_.runCapacity(sf, run.len) == 0) {
+            change(run.allocation, run.allocation.subframe, run.allocation.subframe + run.len, 1);
+            return false;
+        }
+        const Allocation moved = window_.place(sf, run.len);
+        count(&moved, 1, run.len);
+        reservations_.update(handle, {moved, run.len});
+        return true;
+    }
+
+    const Window& window() const { return window_; }
+
+    // Blocks reserved in subframe sf, which must not be retired yet
+    unsigned load(unsigned sf) const {
+        assert(sf >= window_begin_);
+        return sf < window_begin_ + window_len_ ? window_.load(sf) : 0;
+    }
+
+    // Blocks reserved in all subframes so far, retired or not
+    uint64_t reservedBlocks() const { return reserved_blocks_; }
+
+    /* Blocks reserved in [from, to). Both ends must be 0, inside the live
+     * window or among the last ring size retired subframes; subframes past the
+     * window have nothing reserved yet.
+     */
+    uint64_t blocks(unsigned from, unsigned to) const { return blocksBefore(to) - blocksBefore(from); }
+
+    // Average over [from, from + len), same limits as blocks()
+    double avgBlockPerSf (unsigned from, unsigned len) const {
+        return static_cast<double>(blocks(from, from + len)) / len;
     }
 
+    // Share of the live window's K x N blocks that is reserved
+    double occupancy() const {
+        return static_cast<double>(reserved_blocks_ - retired_blocks_) / (uint64_t{window_len_} * rb_per_sf_);
+    }
+
+    // Prints retired summary followed by the live window, [from, from + len) in square brackets
     void printWindow(unsigned from, unsigned len) {
-        auto print = [](const unsigned& n) { std::cout << n << ' '; };
-        const auto first = subframes.cbegin() + from;
-        assert(first + len <= subframes.cend());
-        std::for_each(subframes.cbegin(), first, print);
+        assert(from >= window_begin_);
+        const unsigned window_end = std::max(window_begin_ + window_len_, from + len);
+        auto print = [this](unsigned sf) { std::cout << load(sf) << ' '; };
+        std::cout << "(" << window_begin_ << " retired sf, " << retired_blocks_ << " blocks) ";
+        for (unsigned sf = window_begin_; sf < from; sf++) print(sf);
         std::cout << "[ ";
-        std::for_each(first, first + len, print);
+        for (unsigned sf = from; sf < from + len; sf++) print(sf);
         std::cout << "] ";
-        std::for_each(first + len, subframes.cend(), print);
+        for (unsigned sf = from + len; sf < window_end; sf++) print(sf);
         std::cout << "\n";
     }
 };
+
+using Scheduler = BasicScheduler<CounterWindow>;
+using IndexedScheduler = BasicScheduler<IndexedWindow>;
+using BitmapScheduler = BasicScheduler<BitmapWindow>;
+
+// Scheduler with L, N and K compiled in, see FixedSizes and scheduler_profiles.h
+template <unsigned L, unsigned N, unsigned K>
+using FixedScheduler = BasicScheduler<FixedCounterWindow<L, N, K>>;
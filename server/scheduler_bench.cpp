@@ -0,0 +1,169 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+
+/* Benchmarks of the scheduler and the client/server hot paths. Results are
+ * written to scheduler_bench.json unless --benchmark_out is given, compare
+ * two runs with benchmark's tools/compare.py.
+ */
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "scheduler.h"
+#include "../common.h"
+#include "../cell_datagrams.h"
+#include "../client/fifo.h"
+
+namespace {
+
+/* reserve() of count runs of length L into a K x N window whose first fill
+ * percent blocks are already taken. Args: K, L, N, count, fill.
+ */
+template <typename Sched>
+void BM_Reserve(benchmark::State& state) {
+    const unsigned k = state.range(0);
+    const unsigned len = state.range(1);
+    const unsigned n = state.range(2);
+    const unsigned count = state.range(3);
+    const unsigned fill = state.range(4);
+    Sched prefilled(k, n);
+    prefilled.reserve(0, 1, uint64_t{k} * n * fill / 100);
+    unsigned reserved = 0;
+    Sched scheduler = prefilled;
+    for (auto _ : state) {
+        state.PauseTiming();
+        scheduler = prefilled;      // reuses the copy's buffers, nothing is freed while timing
+        state.ResumeTiming();
+        reserved += scheduler.reserve(0, len, count);
+    }
+    state.counters["granted"] = benchmark::Counter(reserved, benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations() * count);
+}
+
+void reserveSweep(benchmark::internal::Benchmark* bench) {
+    bench->ArgNames({"K", "L", "N", "count", "fill"})
+         ->ArgsProduct({{64, 1024}, {4, 26}, {13, 100}, {1, 80}, {0, 90}});
+}
+
+BENCHMARK_TEMPLATE(BM_Reserve, Scheduler)->Apply(reserveSweep);
+BENCHMARK_TEMPLATE(BM_Reserve, IndexedScheduler)->Apply(reserveSweep);
+BENCHMARK_TEMPLATE(BM_Reserve, BitmapScheduler)->Apply(reserveSweep);
+
+// The enbsim.cfg profile with the generic and the compile-time sized kernels
+void profileSweep(benchmark::internal::Benchmark* bench) {
+    bench->ArgNames({"K", "L", "N", "count", "fill"})
+         ->ArgsProduct({{260}, {4, 26}, {13}, {1, 80}, {0, 90}});
+}
+
+BENCHMARK_TEMPLATE(BM_Reserve, Scheduler)->Apply(profileSweep);
+BENCHMARK_TEMPLATE(BM_Reserve, FixedScheduler<26, 13, 260>)->Apply(profileSweep);
+
+// avgBlockPerSf over the whole run after 10 K subframes of saturated load. Args: K.
+void BM_AvgBlockPerSf(benchmark::State& state) {
+    const unsigned k = state.range(0);
+    const unsigned subframes = 10 * k;
+    Scheduler scheduler(k, 13);
+    for (unsigned sf = 0; sf < subframes; sf++) scheduler.reserve(sf, 26, 40);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(scheduler.avgBlockPerSf(0, subframes + k));
+    }
+}
+BENCHMARK(BM_AvgBlockPerSf)->ArgName("K")->Arg(64)->Arg(1024)->Arg(16384);
+
+// Push/pop pairs on one Fifo shared by all benchmark threads
+void BM_FifoContention(benchmark::State& state) {
+    static Fifo<ResourceRequest> fifo;
+    const ResourceRequest req{static_cast<uint32_t>(state.thread_index()), ResourceType::UL, 26};
+    ResourceRequest item;
+    for (auto _ : state) {
+        fifo.push(req);
+        fifo.pop(item);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FifoContention)->ThreadRange(1, 16)->UseRealTime();
+
+// Receives frames until the batch of assembler is complete
+template <typename T>
+void receiveBatch(int sockfd, CellDatagrams& datagrams, FrameKind kind, BatchAssembler<T>& assembler) {
+    while (true) {
+        const unsigned received = datagrams.receive(sockfd, datagrams.slots(), MSG_WAITFORONE);
+        for (unsigned i = 0; i < received; i++) {
+            FrameHeader header;
+            if (parseFrame(datagrams.data(i), datagrams.length(i), kind, header)
+                && assembler.add(header, datagrams.data(i), datagrams.length(i)) == Reassembly::COMPLETE) {
+                return;
+            }
+        }
+    }
+}
+
+/* A batch of requests and its responses framed, sent and reassembled between
+ * two loopback sockets. Args: records.
+ */
+void BM_SockRoundTrip(benchmark::State& state) {
+    const unsigned records = state.range(0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int server = socket(AF_INET, SOCK_DGRAM, 0);
+    const int client = socket(AF_INET, SOCK_DGRAM, 0);
+    socklen_t len = sizeof(addr);
+    if (server < 0 || client < 0 || bind(server, reinterpret_cast<const struct sockaddr *>(&addr), len) < 0
+        || getsockname(server, reinterpret_cast<struct sockaddr *>(&addr), &len) < 0) {
+        state.SkipWithError("cannot open loopback sockets");
+        return;
+    }
+    std::vector<ResourceRequest> requests(records);
+    std::vector<SchedulerResponse> responses(records);
+    for (unsigned i = 0; i < records; i++) {
+        requests[i] = {i, i % 2 ? ResourceType::DL : ResourceType::UL, 26};
+        responses[i] = {i, AllocationStatus::SUCCESS, SchedulerResponse::NO_RB, 0};
+    }
+    CellDatagrams client_frames(64);
+    CellDatagrams server_frames(64);
+    BatchAssembler<ResourceRequest> received_requests;
+    BatchAssembler<SchedulerResponse> received_responses;
+    uint32_t sf = 0;
+    for (auto _ : state) {
+        client_frames.queue(client, 0, sf, Span<const ResourceRequest>{requests.data(), requests.size()}, addr);
+        client_frames.flush(client);
+        receiveBatch(server, server_frames, FrameKind::REQUESTS, received_requests);
+        for (auto& resp : responses) resp.subframe = sf + 1;
+        server_frames.queue(server, 0, sf, Span<const SchedulerResponse>{responses.data(), responses.size()}, server_frames.address(0));
+        server_frames.flush(server);
+        receiveBatch(client, client_frames, FrameKind::RESPONSES, received_responses);
+        sf++;
+    }
+    close(server);
+    close(client);
+    state.SetItemsProcessed(state.iterations() * records);
+    state.counters["bytes"] = static_cast<double>(client_frames.bytes() + server_frames.bytes()) / 2 / state.iterations();
+}
+BENCHMARK(BM_SockRoundTrip)->ArgName("records")->Arg(1)->Arg(16)->Arg(80)->Arg(10000);
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::vector<char*> args(argv, argv + argc);
+    std::string out = "--benchmark_out=scheduler_bench.json";
+    std::string out_format = "--benchmark_out_format=json";
+    bool has_out = false;
+    for (const char* arg : args) has_out |= std::string(arg).rfind("--benchmark_out=", 0) == 0;
+    if (!has_out) {
+        args.push_back(out.data());
+        args.push_back(out_format.data());
+    }
+    int num_args = args.size();
+    benchmark::Initialize(&num_args, args.data());
+    if (benchmark::ReportUnrecognizedArguments(num_args, args.data())) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
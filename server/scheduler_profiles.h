@@ -0,0 +1,55 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <tuple>
+
+#include "scheduler.h"
+#include "../common.h"
+
+// (L, N, K) of a production profile, the LINEAR engine has FixedScheduler kernels compiled for it
+template <unsigned L_, unsigned N_, unsigned K_>
+struct SchedulerProfile {
+    static constexpr unsigned L = L_;
+    static constexpr unsigned N = N_;
+    static constexpr unsigned K = K_;
+    using Sched = FixedScheduler<L, N, K>;
+
+    static bool matches(const Configuration& cfg) { return cfg.L == L && cfg.N == N && cfg.K == K; }
+};
+
+/* Dispatch table of the specialised profiles. Every entry instantiates the
+ * whole server for its scheduler, so keep it to the sizes actually deployed.
+ */
+using SchedulerProfiles = std::tuple<
+    SchedulerProfile<26, 13, 260>,      // enbsim.cfg
+    SchedulerProfile<16, 64, 160>,      // Configuration defaults
+    SchedulerProfile<26, 25, 260>,      // 5 MHz carrier
+    SchedulerProfile<26, 100, 260>      // 20 MHz carrier
+>;
+
+// Names a scheduler type for the generic lambdas passed to withLinearScheduler()
+template <typename Sched>
+struct SchedulerTag {
+    using type = Sched;
+};
+
+template <typename Run, typename... Profiles>
+bool runProfile(const Configuration& cfg, Run& run, std::tuple<Profiles...>*) {
+    return ((Profiles::matches(cfg) && (run(SchedulerTag<typename Profiles::Sched>{}), true)) || ...);
+}
+
+inline bool hasSchedulerProfile(const Configuration& cfg) {
+    auto ignore = [](auto) {};
+    return runProfile(cfg, ignore, static_cast<SchedulerProfiles*>(nullptr));
+}
+
+// Calls run(SchedulerTag<FixedScheduler<...>>) for a profile matching cfg, run(SchedulerTag<Scheduler>) otherwise
+template <typename Run>
+void withLinearScheduler(const Configuration& cfg, Run run) {
+    if (!runProfile(cfg, run, static_cast<SchedulerProfiles*>(nullptr))) run(SchedulerTag<Scheduler>{});
+}
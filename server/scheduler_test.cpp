@@ -1,5 +1,17 @@
 #include <gtest/gtest.h>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
 #include "scheduler.h"
+#include "cell.h"
+#include "shard.h"
+#include "../wire.h"
+#include "../client/ue_stats.h"
+#include "../sweep/sweep.h"
 
 class SchedulerTest : public ::testing::Test {
 protected:
@@ -86,6 +98,701 @@ TEST_F(SchedulerTest, ReserveMultipleDataLenTest) {
     EXPECT_EQ(scheduler.total, 4);
 }
 
+// Test case for running far past simulation_len with the circular window
+TEST_F(SchedulerTest, RingWindowLongRunTest) {
+    Scheduler scheduler(10, 5, 3);
+    // One block per subframe, well beyond the ring size
+    for (unsigned sf = 0; sf < 1000; sf++) {
+        EXPECT_EQ(scheduler.reserve(sf, 1, 1), 1);
+    }
+    // Retired summary plus the live window
+    EXPECT_EQ(scheduler.avgBlockPerSf(0, 1000), 1.0);
+    // Subframes past the window have nothing reserved
+    EXPECT_EQ(scheduler.avgBlockPerSf(999, 5), 0.2);
+}
+
+// Range queries of the running counts must match summing the window and the retired loads
+template <typename Sched>
+static void expectBlockCountsMatch(unsigned K, unsigned N, unsigned seed) {
+    Sched scheduler(K, N);
+    std::vector<uint64_t> retired;   // final load of every retired subframe
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<unsigned> step(0, 3), len(1, K / 3), num(0, 2 * N);
+    std::vector<Allocation> out;
+    unsigned sf = 0;
+    for (unsigned i = 0; i < 500; i++) {
+        const unsigned next = sf + step(rng);
+        for (; sf < next; sf++) retired.push_back(scheduler.load(sf));
+        std::vector<unsigned> lengths(num(rng));
+        for (auto& l : lengths) l = len(rng);
+        if (i % 2) scheduler.reserve(sf, len(rng), num(rng));
+        else scheduler.pack(sf, lengths, static_cast<PackingPolicy>(i % 3), out);
+
+        const uint64_t live = scheduler.window().sum(sf, sf + K);
+        ASSERT_EQ(scheduler.blocks(sf, sf + K), live);
+        const unsigned a = sf + len(rng), b = a + len(rng);
+        ASSERT_EQ(scheduler.blocks(a, b), scheduler.window().sum(a, std::min(b, sf + K)));
+        const unsigned back = std::min<unsigned>(sf, len(rng));   // reaching into the retired subframes
+        const uint64_t history = std::accumulate(retired.end() - back, retired.end(), uint64_t{0});
+        ASSERT_EQ(scheduler.blocks(sf - back, a), history + scheduler.window().sum(sf, a));
+        ASSERT_EQ(scheduler.reservedBlocks(), std::accumulate(retired.begin(), retired.end(), live));
+        ASSERT_DOUBLE_EQ(scheduler.occupancy(), static_cast<double>(live) / (K * N));
+    }
+}
+
+// Test case for the incremental block counts of both ring engines
+TEST_F(SchedulerTest, BlockCountsMatchWindowTest) {
+    expectBlockCountsMatch<Scheduler>(40, 5, 99);
+    expectBlockCountsMatch<BitmapScheduler>(26, 13, 7);
+}
+
+// Test case for window slots being reused after subframes retire
+TEST_F(SchedulerTest, RingWindowReuseTest) {
+    Scheduler scheduler(4, 1);
+    EXPECT_EQ(scheduler.reserve(0, 4, 2), 1);  // fills subframes 0..3
+    EXPECT_EQ(scheduler.reserve(2, 2, 2), 1);  // only 4..5 are free
+    EXPECT_EQ(scheduler.reserve(10, 4, 1), 1); // old slots were cleared
+    EXPECT_EQ(scheduler.avgBlockPerSf(0, 14), 10.0 / 14);
+}
+
+// Random reserve sequences must leave both engines in the same state
+static void expectEnginesMatch(unsigned K, unsigned N, unsigned max_len, unsigned max_num, unsigned seed) {
+    Scheduler linear(K, N);
+    IndexedScheduler indexed(K, N);
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<unsigned> step(0, 3), len(1, max_len), num(0, max_num);
+    unsigned sf = 0;
+    for (unsigned i = 0; i < 2000; i++) {
+        sf += step(rng);
+        const unsigned data_len = len(rng), count = num(rng);
+        ASSERT_EQ(linear.reserve(sf, data_len, count), indexed.reserve(sf, data_len, count));
+        for (unsigned s = sf; s < sf + K; s++) {
+            ASSERT_EQ(linear.load(s), indexed.load(s));
+        }
+    }
+    EXPECT_EQ(linear.success, indexed.success);
+    EXPECT_EQ(linear.avgBlockPerSf(0, sf + K), indexed.avgBlockPerSf(0, sf + K));
+    EXPECT_EQ(linear.avgBlockPerSf(sf + 3, 20), indexed.avgBlockPerSf(sf + 3, 20));
+}
+
+// Test case for the indexed engine reproducing linear first-fit results exactly
+TEST_F(SchedulerTest, IndexedMatchesLinearTest) {
+    expectEnginesMatch(40, 5, 12, 8, 12345);
+}
+
+// Test case for the batched kernel placing several runs in the same subframe
+TEST_F(SchedulerTest, BatchedReserveWideSubframesTest) {
+    expectEnginesMatch(100, 64, 30, 300, 777);
+    expectEnginesMatch(37, 1, 4, 20, 42);
+}
+
+// Test case for the compile-time sized kernels placing runs exactly like the generic ones
+TEST_F(SchedulerTest, FixedSchedulerMatchesGenericTest) {
+    Scheduler generic(260, 13);
+    FixedScheduler<26, 13, 260> fixed(260, 13);
+    std::mt19937 rng(2024);
+    std::uniform_int_distribution<unsigned> step(0, 2), len(1, 40), num(0, 12), pick(0, 3);
+    std::vector<Allocation> generic_out, fixed_out;
+    unsigned sf = 0;
+    for (unsigned i = 0; i < 1000; i++) {
+        sf += step(rng);
+        std::vector<unsigned> lengths(num(rng));
+        for (auto& l : lengths) l = pick(rng) ? 26 : len(rng);   // mostly L, the specialised run length
+        const auto policy = static_cast<PackingPolicy>(i % 3);
+        ASSERT_EQ(generic.pack(sf, lengths, policy, generic_out), fixed.pack(sf, lengths, policy, fixed_out));
+        for (std::size_t r = 0; r < lengths.size(); r++) ASSERT_EQ(generic_out[r].subframe, fixed_out[r].subframe);
+        ASSERT_EQ(generic.reserve(sf, 26, 2), fixed.reserve(sf, 26, 2));
+    }
+    EXPECT_EQ(generic.success, fixed.success);
+    EXPECT_EQ(generic.avgBlockPerSf(0, sf + 260), fixed.avgBlockPerSf(0, sf + 260));
+}
+
+// Release, resize and move keep the window, the block counts and the handles consistent
+template <typename Sched>
+static void expectReservationChanges() {
+    Sched scheduler(10, 2);
+    Allocation out[3]{};
+    ReservationHandle handles[3];
+    EXPECT_EQ(scheduler.reserve(0, 4, 3, out, handles), 3);    // 0..3 twice, 4..7 once
+    EXPECT_EQ(scheduler.reservations(), 3);
+    EXPECT_TRUE(scheduler.release(handles[0]));
+    EXPECT_FALSE(scheduler.release(handles[0]));
+    EXPECT_EQ(scheduler.load(0), 1);
+    EXPECT_EQ(scheduler.blocks(0, 10), 8);
+
+    EXPECT_TRUE(scheduler.resize(handles[1], 2));               // 0..1
+    EXPECT_EQ(scheduler.load(2), 0);
+    EXPECT_TRUE(scheduler.resize(handles[2], 6));               // 4..9
+    EXPECT_FALSE(scheduler.resize(handles[2], 7));              // past the window
+    EXPECT_TRUE(scheduler.move(handles[1], 7));                 // 7..8
+    EXPECT_EQ(scheduler.reservation(handles[1])->allocation.subframe, 7);
+    EXPECT_EQ(scheduler.load(0), 0);
+    EXPECT_EQ(scheduler.load(8), 2);
+    EXPECT_EQ(scheduler.blocks(0, 10), 8);
+    unsigned loads = 0;
+    for (unsigned sf = 0; sf < 10; sf++) loads += scheduler.load(sf);
+    EXPECT_EQ(loads, 8);
+
+    // full subframes stay full
+    std::vector<Allocation> packed;
+    std::vector<ReservationHandle> packed_handles;
+    scheduler.pack(0, {2, 2, 2, 2, 2, 2}, PackingPolicy::FIRST_FIT, packed, {}, packed_handles);
+    for (unsigned sf = 0; sf < 10; sf++) EXPECT_LE(scheduler.load(sf), 2);
+    EXPECT_FALSE(scheduler.move(handles[2], 0));
+
+    // handles expire with the last subframe of their run, their slots are reused
+    scheduler.reserve(9, 1, 0);
+    EXPECT_EQ(scheduler.reservation(handles[1]), nullptr);
+    EXPECT_NE(scheduler.reservation(handles[2]), nullptr);
+    EXPECT_FALSE(scheduler.resize(handles[2], 5));              // would end in retired subframes
+    scheduler.reserve(20, 1, 1, nullptr, handles);
+    EXPECT_EQ(scheduler.reservations(), 1);
+    EXPECT_FALSE(scheduler.release(packed_handles[0]));
+}
+
+// After runs were changed a free first subframe no longer means a free run, reserve() must check all of it
+template <typename Sched>
+static void expectReserveAfterChanges() {
+    Sched scheduler(10, 1);
+    Allocation out[2]{};
+    ReservationHandle handles[2];
+    EXPECT_EQ(scheduler.reserve(0, 4, 2, out, handles), 2);    // 0..3, 4..7
+    EXPECT_TRUE(scheduler.release(handles[0]));
+    EXPECT_TRUE(scheduler.move(handles[1], 2));                 // 2..5
+    EXPECT_EQ(scheduler.reserve(0, 4, 1, out), 1);
+    EXPECT_EQ(out[0].subframe, 6);
+    for (unsigned sf = 0; sf < 10; sf++) EXPECT_EQ(scheduler.load(sf), sf >= 2) << sf;
+    EXPECT_EQ(scheduler.reserve(0, 2, 1), 1);                   // 0..1
+    EXPECT_EQ(scheduler.reserve(0, 1, 1), 0);
+}
+
+// Test case for changing reservations through handles in every engine
+TEST_F(SchedulerTest, ReservationHandlesTest) {
+    expectReservationChanges<Scheduler>();
+    expectReservationChanges<IndexedScheduler>();
+    expectReservationChanges<BitmapScheduler>();
+    expectReserveAfterChanges<Scheduler>();
+    expectReserveAfterChanges<IndexedScheduler>();
+    expectReserveAfterChanges<BitmapScheduler>();
+}
+
+// Test case for a batch that stops on the first run not fitting into the window
+TEST_F(SchedulerTest, BatchedReserveWindowEndTest) {
+    Scheduler scheduler(10, 2);
+    EXPECT_EQ(scheduler.reserve(0, 4, 7), 4);  // 0..3 twice, 4..7 twice
+    EXPECT_EQ(scheduler.load(3), 2);
+    EXPECT_EQ(scheduler.load(7), 2);
+    EXPECT_EQ(scheduler.load(8), 0);
+}
+
+// Test case for the bitmap grid assigning distinct blocks held for the whole run
+TEST_F(SchedulerTest, BitmapAssignsBlocksTest) {
+    BitmapScheduler scheduler(10, 3);
+    std::vector<Allocation> allocations(5);
+    EXPECT_EQ(scheduler.reserve(0, 4, 5, allocations.data()), 5);
+    // three runs from subframe 0 on blocks 0..2, then two from subframe 4
+    for (unsigned i = 0; i < 3; i++) {
+        EXPECT_EQ(allocations[i].subframe, 0);
+        EXPECT_EQ(allocations[i].rb, i);
+    }
+    EXPECT_EQ(allocations[3].subframe, 4);
+    EXPECT_EQ(allocations[3].rb, 0);
+    EXPECT_EQ(allocations[4].rb, 1);
+    for (unsigned sf = 4; sf < 8; sf++) {
+        EXPECT_TRUE(scheduler.window().used(sf, 1));
+        EXPECT_FALSE(scheduler.window().used(sf, 2));
+    }
+    EXPECT_EQ(scheduler.load(3), 3);
+    EXPECT_EQ(scheduler.load(4), 2);
+}
+
+// Test case for a run needing the same block free in every subframe it covers
+TEST_F(SchedulerTest, BitmapRunNeedsSameBlockTest) {
+    BitmapScheduler scheduler(10, 2);
+    Allocation allocation{};
+    EXPECT_EQ(scheduler.reserve(0, 2, 1, &allocation), 1);  // block 0, subframes 0..1
+    EXPECT_EQ(scheduler.reserve(1, 3, 1, &allocation), 1);  // block 1, subframes 1..3
+    // block 0 is free at 1 but not at 2..3, block 1 is taken, so the run starts at 2
+    EXPECT_EQ(scheduler.reserve(1, 3, 1, &allocation), 1);
+    EXPECT_EQ(allocation.subframe, 2);
+    EXPECT_EQ(allocation.rb, 0);
+}
+
+// Test case for grids wider than one 64-bit word
+TEST_F(SchedulerTest, BitmapWideGridTest) {
+    BitmapScheduler scheduler(4, 100);
+    std::vector<Allocation> allocations(150);
+    EXPECT_EQ(scheduler.reserve(0, 4, 150, allocations.data()), 100);
+    EXPECT_EQ(allocations[99].rb, 99);
+    EXPECT_EQ(scheduler.avgBlockPerSf(0, 4), 100.0);
+}
+
+// Single-subframe runs are unconstrained in frequency, the grid matches the counters
+TEST_F(SchedulerTest, BitmapMatchesCountersForUnitRunsTest) {
+    Scheduler counters(20, 7);
+    BitmapScheduler bitmap(20, 7);
+    std::mt19937 rng(99);
+    std::uniform_int_distribution<unsigned> step(0, 2), num(0, 20);
+    unsigned sf = 0;
+    for (unsigned i = 0; i < 500; i++) {
+        sf += step(rng);
+        const unsigned count = num(rng);
+        ASSERT_EQ(counters.reserve(sf, 1, count), bitmap.reserve(sf, 1, count));
+    }
+    EXPECT_EQ(counters.avgBlockPerSf(0, sf + 20), bitmap.avgBlockPerSf(0, sf + 20));
+}
+
+// Test case for mixed lengths never overbooking a subframe
+TEST_F(SchedulerTest, PackMixedLengthsFitEntirelyTest) {
+    Scheduler scheduler(20, 2);
+    std::vector<Allocation> out;
+    EXPECT_EQ(scheduler.pack(0, {5, 2, 2, 10, 10, 7}, PackingPolicy::FIRST_FIT, out), 5);
+    EXPECT_EQ(out[0].subframe, 0);  // 0..4
+    EXPECT_EQ(out[1].subframe, 0);  // 0..1, subframes 0..1 full now
+    EXPECT_EQ(out[2].subframe, 2);  // 2..3, subframes 2..4 full now
+    EXPECT_EQ(out[3].subframe, 4);  // 4..13, subframes 0..4 full now
+    EXPECT_EQ(out[4].subframe, 5);  // 5..14, subframes 0..13 full now
+    EXPECT_EQ(out[5].subframe, Allocation::NO_SUBFRAME);
+    EXPECT_EQ(scheduler.success, 5);
+    EXPECT_EQ(scheduler.total, 6);
+    for (unsigned sf = 0; sf < 20; sf++) EXPECT_LE(scheduler.load(sf), 2);
+}
+
+// Test case for best fit choosing the tightest spot that still fits
+TEST_F(SchedulerTest, PackBestFitTightestSpotTest) {
+    IndexedWindow window(20, 3);
+    window.place(5, 4);
+    window.place(5, 4);                    // 5..8 has one block left, 0..4 is empty
+    Allocation out{};
+    EXPECT_EQ(packBestFit(window, 0, 20, 2, out), 1);
+    EXPECT_EQ(out.subframe, 4);                        // 4..5 leaves one run of room, earliest such spot
+    EXPECT_EQ(packFirstFit(window, 0, 20, 2, out), 1);
+    EXPECT_EQ(out.subframe, 0);
+    EXPECT_EQ(packBestFit(window, 0, 20, 6, out), 1);  // 5 is full, 6..11 is tighter than 9..14
+    EXPECT_EQ(out.subframe, 6);
+    EXPECT_EQ(window.load(5), 3);
+    EXPECT_EQ(window.load(4), 1);
+}
+
+// Test case for longest first packing more blocks than arrival order
+TEST_F(SchedulerTest, PackLongestFirstTest) {
+    const std::vector<unsigned> lengths{3, 3, 3, 10};
+    Scheduler first_fit(10, 1), longest_first(10, 1);
+    std::vector<Allocation> out;
+    EXPECT_EQ(first_fit.pack(0, lengths, PackingPolicy::FIRST_FIT, out), 3);
+    EXPECT_EQ(out[3].subframe, Allocation::NO_SUBFRAME);
+    EXPECT_EQ(longest_first.pack(0, lengths, PackingPolicy::LONGEST_FIRST, out), 1);
+    EXPECT_EQ(out[3].subframe, 0);
+    EXPECT_EQ(first_fit.packing_stats[0].granted_blocks, 9);
+    EXPECT_EQ(longest_first.packing_stats[2].granted_blocks, 10);
+    EXPECT_EQ(longest_first.packing_stats[2].requested_blocks, 19);
+}
+
+// Test case for mixed length packing on the bitmap grid reporting blocks
+TEST_F(SchedulerTest, PackBitmapTest) {
+    BitmapScheduler scheduler(8, 2);
+    std::vector<Allocation> out;
+    EXPECT_EQ(scheduler.pack(0, {8, 3, 6, 1}, PackingPolicy::FIRST_FIT, out), 3);
+    EXPECT_EQ(out[0].rb, 0);
+    EXPECT_EQ(out[1].rb, 1);
+    EXPECT_EQ(out[1].subframe, 0);
+    EXPECT_EQ(out[2].subframe, Allocation::NO_SUBFRAME);
+    EXPECT_EQ(out[3].subframe, 3);
+    EXPECT_EQ(out[3].rb, 1);
+}
+
+// Equal lengths take the batched reserve path and give the same result
+TEST_F(SchedulerTest, PackUniformMatchesReserveTest) {
+    Scheduler reserved(30, 4), packed(30, 4);
+    std::vector<Allocation> out;
+    for (unsigned sf = 0; sf < 50; sf++) {
+        EXPECT_EQ(reserved.reserve(sf, 6, 5), packed.pack(sf, std::vector<unsigned>(5, 6), PackingPolicy::FIRST_FIT, out));
+    }
+    EXPECT_EQ(reserved.avgBlockPerSf(0, 80), packed.avgBlockPerSf(0, 80));
+}
+
+// A cell answers requests of both directions in request order, one subframe per batch
+TEST_F(SchedulerTest, CellScheduleTest) {
+    Configuration cfg;
+    cfg.DEBUGPRINTS = false;
+    Cell<Scheduler> cell(cfg, 5);
+    const std::vector<ResourceRequest> requests{{7, ResourceType::UL, 4}, {3, ResourceType::DL, 4}, {9, ResourceType::UL, 4}};
+    std::vector<SchedulerResponse> responses(requests.size());
+    EXPECT_EQ(cell.schedule({requests.data(), requests.size()}, responses.data()), 3);
+    EXPECT_EQ(responses[0].ue_id, 7);
+    EXPECT_EQ(responses[1].ue_id, 3);
+    EXPECT_EQ(responses[2].ue_id, 9);
+    EXPECT_EQ(responses[0].status, AllocationStatus::SUCCESS);
+    EXPECT_EQ(cell.uplink.success, 2);
+    EXPECT_EQ(cell.downlink.success, 1);
+    EXPECT_EQ(cell.schedule({nullptr, 0}, nullptr), 0);
+    EXPECT_EQ(cell.currentSubframe(), 2);
+    EXPECT_EQ(cell.id(), 5);
+}
+
+// Two UEs compete for the one block freed every subframe, the policy decides who gets it
+static const UeTable& runTwoUes(Cell<Scheduler>& cell) {
+    std::vector<SchedulerResponse> responses(2);
+    const std::vector<ResourceRequest> requests{{0, ResourceType::UL, 1}, {1, ResourceType::UL, 1}};
+    for (unsigned sf = 0; sf < 40; sf++) cell.schedule({requests.data(), requests.size()}, responses.data());
+    return cell.ul_ue_table;
+}
+
+// Test case for the scheduling policies ordering a batch
+TEST_F(SchedulerTest, SchedulingPolicyTest) {
+    Configuration cfg;
+    cfg.DEBUGPRINTS = false;
+    cfg.K = 4;
+    cfg.N = 1;
+    cfg.M = 2;
+    Cell<Scheduler> fifo(cfg);
+    const UeTable& fifo_ues = runTwoUes(fifo);
+    EXPECT_GT(fifo_ues.grantedBlocks(0), 35);       // first in every batch
+    EXPECT_LT(fifo_ues.grantedBlocks(1), 5);
+    EXPECT_LT(jainFairness({&fifo_ues}), 0.6);
+
+    cfg.SCHEDULING_POLICY = SchedulingPolicy::ROUND_ROBIN;
+    Cell<Scheduler> round_robin(cfg);
+    const UeTable& rr_ues = runTwoUes(round_robin);
+    EXPECT_LE(std::max(rr_ues.grantedBlocks(0), rr_ues.grantedBlocks(1)) - std::min(rr_ues.grantedBlocks(0), rr_ues.grantedBlocks(1)), 1);
+    EXPECT_GT(jainFairness({&rr_ues}), 0.99);
+
+    cfg.SCHEDULING_POLICY = SchedulingPolicy::PROPORTIONAL_FAIR;
+    Cell<Scheduler> proportional_fair(cfg);
+    const UeTable& pf_ues = runTwoUes(proportional_fair);
+    EXPECT_GT(jainFairness({&pf_ues}), 0.99);
+
+    UeTable max_throughput(3);
+    std::vector<unsigned> order;
+    max_throughput.rank(SchedulingPolicy::MAX_THROUGHPUT, 0, {0, 1, 2}, {1, 3, 1}, order);
+    EXPECT_EQ(order, (std::vector<unsigned>{1, 0, 2}));     // longest first, then arrival order
+    max_throughput.rank(SchedulingPolicy::FIFO, 0, {0, 1, 2}, {1, 3, 1}, order);
+    EXPECT_TRUE(order.empty());
+}
+
+// The pipeline's separate steps give the same responses as schedule()
+TEST_F(SchedulerTest, CellStepsMatchScheduleTest) {
+    Configuration cfg;
+    cfg.DEBUGPRINTS = false;
+    Cell<Scheduler> sequential(cfg), staged(cfg);
+    CellBatch batch;
+    std::mt19937 rng(3);
+    for (unsigned sf = 0; sf < 100; sf++) {
+        std::vector<ResourceRequest> requests(rng() % 20);
+        for (auto& req : requests) {
+            req = {static_cast<uint32_t>(rng() % 80), rng() % 2 ? ResourceType::UL : ResourceType::DL, static_cast<uint16_t>(1 + rng() % 30)};
+        }
+        std::vector<SchedulerResponse> expected(requests.size()), actual(requests.size());
+        const unsigned num_expected = sequential.schedule({requests.data(), requests.size()}, expected.data());
+        staged.decode({requests.data(), requests.size()}, batch);
+        staged.scheduleDownlink(batch);
+        staged.scheduleUplink(batch);
+        ASSERT_EQ(staged.respond({requests.data(), requests.size()}, batch, actual.data()), num_expected);
+        for (unsigned i = 0; i < num_expected; i++) {
+            EXPECT_EQ(actual[i].status, expected[i].status);
+            EXPECT_EQ(actual[i].subframe, expected[i].subframe);
+        }
+    }
+}
+
+// Frames of a batch bigger than one datagram reassemble in any order, stale, repeated and truncated frames are rejected
+TEST_F(SchedulerTest, WireFramesRoundTripTest) {
+    std::mt19937 rng(7);
+    std::vector<ResourceRequest> requests(10000);
+    for (auto& req : requests) {
+        req = {static_cast<uint32_t>(rng() % 20000), rng() % 2 ? ResourceType::UL : ResourceType::DL, static_cast<uint16_t>(rng() % 1000)};
+    }
+    std::vector<std::vector<uint8_t>> frames;
+    for (std::size_t next = 0; next < requests.size() || frames.empty(); ) {
+        std::vector<uint8_t> frame(FRAME_MTU);
+        frame.resize(encodeFrame(3, 42, Span<const ResourceRequest>{requests.data(), requests.size()}, next, frame.data()));
+        frames.push_back(std::move(frame));
+    }
+    EXPECT_GT(frames.size(), 1);
+    EXPECT_LT(frames.size() * FRAME_MTU, requests.size() * sizeof(ResourceRequest));
+
+    BatchAssembler<ResourceRequest> assembler;
+    FrameHeader header;
+    for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame) {
+        ASSERT_TRUE(parseFrame(frame->data(), frame->size(), FrameKind::REQUESTS, header));
+        EXPECT_EQ(header.cell_id, 3);
+        EXPECT_FALSE(parseFrame(frame->data(), frame->size(), FrameKind::RESPONSES, header));
+        ASSERT_TRUE(parseFrame(frame->data(), frame->size(), FrameKind::REQUESTS, header));
+        const Reassembly expected = frame + 1 == frames.rend() ? Reassembly::COMPLETE : Reassembly::INCOMPLETE;
+        EXPECT_EQ(assembler.add(header, frame->data(), frame->size()), expected);
+    }
+    EXPECT_EQ(assembler.subframe(), 42);
+    ASSERT_EQ(assembler.records().size(), requests.size());
+    for (std::size_t i = 0; i < requests.size(); i++) {
+        EXPECT_EQ(assembler.records()[i].ue_id, requests[i].ue_id);
+        EXPECT_EQ(assembler.records()[i].resource_type, requests[i].resource_type);
+        EXPECT_EQ(assembler.records()[i].data_length, requests[i].data_length);
+    }
+    ASSERT_TRUE(parseFrame(frames[0].data(), frames[0].size(), FrameKind::REQUESTS, header));
+    EXPECT_EQ(assembler.add(header, frames[0].data(), frames[0].size()), Reassembly::STALE);
+
+    // a repeated frame neither counts twice nor completes the batch early
+    BatchAssembler<ResourceRequest> duplicates;
+    for (std::size_t i = 0; i < frames.size(); i++) {
+        ASSERT_TRUE(parseFrame(frames[i].data(), frames[i].size(), FrameKind::REQUESTS, header));
+        const Reassembly expected = i + 1 == frames.size() ? Reassembly::COMPLETE : Reassembly::INCOMPLETE;
+        EXPECT_EQ(duplicates.add(header, frames[i].data(), frames[i].size()), expected);
+        EXPECT_EQ(duplicates.add(header, frames[i].data(), frames[i].size()), Reassembly::STALE);
+    }
+    ASSERT_EQ(duplicates.records().size(), requests.size());
+    for (std::size_t i = 0; i < requests.size(); i++) EXPECT_EQ(duplicates.records()[i].ue_id, requests[i].ue_id);
+
+    ASSERT_TRUE(parseFrame(frames[0].data(), frames[0].size(), FrameKind::REQUESTS, header));
+    header.subframe = 43;
+    EXPECT_EQ(assembler.add(header, frames[0].data(), frames[0].size() - 1), Reassembly::MALFORMED);
+
+    const std::vector<SchedulerResponse> responses{{7, AllocationStatus::SUCCESS, 12, 50},
+                                                   {5, AllocationStatus::FAIL, SchedulerResponse::NO_RB, 0},
+                                                   {9, AllocationStatus::SUCCESS, SchedulerResponse::NO_RB, 44}};
+    std::vector<uint8_t> frame(FRAME_MTU);
+    std::size_t next = 0;
+    frame.resize(encodeFrame(0, 44, Span<const SchedulerResponse>{responses.data(), responses.size()}, next, frame.data()));
+    EXPECT_EQ(frame.size(), sizeof(FrameHeader) + 3 + 2 + 2);
+    BatchAssembler<SchedulerResponse> response_assembler;
+    ASSERT_TRUE(parseFrame(frame.data(), frame.size(), FrameKind::RESPONSES, header));
+    ASSERT_EQ(response_assembler.add(header, frame.data(), frame.size()), Reassembly::COMPLETE);
+    for (std::size_t i = 0; i < responses.size(); i++) {
+        EXPECT_EQ(response_assembler.records()[i].ue_id, responses[i].ue_id);
+        EXPECT_EQ(response_assembler.records()[i].status, responses[i].status);
+        EXPECT_EQ(response_assembler.records()[i].rb, responses[i].rb);
+        EXPECT_EQ(response_assembler.records()[i].subframe, responses[i].subframe);
+    }
+}
+
+static std::vector<uint8_t> requestFrame(uint32_t cell_id, uint32_t sf, const std::vector<ResourceRequest>& requests = {}) {
+    std::vector<uint8_t> frame(FRAME_MTU);
+    std::size_t next = 0;
+    frame.resize(encodeFrame(cell_id, sf, Span<const ResourceRequest>{requests.data(), requests.size()}, next, frame.data()));
+    return frame;
+}
+
+// Batches are on time within the grace tick, late after it, and subframes never received are missed once at exit
+TEST_F(SchedulerTest, ShardInboxDeadlinesTest) {
+    Configuration cfg;
+    cfg.SIMULATION_PERIOD_SF = 10;
+    std::vector<Cell<Scheduler>> cells;
+    cells.emplace_back(cfg, 0);
+    cells.emplace_back(cfg, 1);
+    ServerMetrics metrics;
+    ShardInbox<Scheduler> inbox(cfg, cells, 1, metrics);
+    const auto add = [&inbox](uint32_t cell_id, uint32_t sf) {
+        const auto frame = requestFrame(cell_id, sf, {{cell_id * 10, ResourceType::UL, 3}});
+        return inbox.add(frame.data(), frame.size());
+    };
+
+    ASSERT_EQ(add(0, 0), 0);
+    EXPECT_FALSE(inbox.late(0));
+    inbox.tick(1);
+    ASSERT_EQ(add(1, 0), 1);                    // in the grace tick
+    EXPECT_FALSE(inbox.late(1));
+    inbox.tick(1);                              // closes subframe 0
+    ASSERT_EQ(add(0, 1), 0);
+    inbox.tick(1);                              // closes subframe 1, cell 1 missed it
+    EXPECT_EQ(metrics.missed_batches.count(), 1);
+    ASSERT_EQ(add(1, 1), 1);
+    EXPECT_TRUE(inbox.late(1));
+    EXPECT_EQ(inbox.batch(1).subframe(), 1);
+    EXPECT_EQ(metrics.late_batches.count(), 1);
+    EXPECT_EQ(metrics.missed_batches.count(), 1);
+
+    // the idle exit closes the rest of the run
+    EXPECT_FALSE(inbox.done());
+    inbox.closeBefore(cfg.SIMULATION_PERIOD_SF);
+    inbox.closeBefore(cfg.SIMULATION_PERIOD_SF);
+    EXPECT_EQ(metrics.missed_batches.count(), 1 + 8 + 8);
+    EXPECT_EQ(metrics.late_batches.count(), 1);
+    EXPECT_EQ(metrics.rejected_frames.count(), 0);
+
+    std::ostringstream dump;
+    dumpMetrics(dump, {}, metrics.counters());
+    const auto line = dump.str().find("missed batches");
+    ASSERT_NE(line, std::string::npos);
+    EXPECT_EQ(dump.str().find("17\n", line), dump.str().find('\n', line) - 2);
+}
+
+// A lost batch is missed when its successor completes, even within the grace tick, and only once
+TEST_F(SchedulerTest, ShardInboxLostBatchTest) {
+    Configuration cfg;
+    cfg.SIMULATION_PERIOD_SF = 10;
+    std::vector<Cell<Scheduler>> cells;
+    cells.emplace_back(cfg, 0);
+    ServerMetrics metrics;
+    ShardInbox<Scheduler> inbox(cfg, cells, 1, metrics);
+
+    auto frame = requestFrame(0, 0);
+    ASSERT_EQ(inbox.add(frame.data(), frame.size()), 0);
+    inbox.tick(1);
+    frame = requestFrame(0, 2);                 // subframe 1 was lost
+    ASSERT_EQ(inbox.add(frame.data(), frame.size()), 0);
+    EXPECT_FALSE(inbox.late(0));
+    EXPECT_EQ(metrics.missed_batches.count(), 1);
+    inbox.tick(2);                              // closes subframes 0 and 1
+    EXPECT_EQ(metrics.missed_batches.count(), 1);
+
+    frame = requestFrame(0, 1);
+    EXPECT_EQ(inbox.add(frame.data(), frame.size()), ShardInbox<Scheduler>::NO_CELL);
+    EXPECT_EQ(metrics.rejected_frames.count(), 1);
+    for (uint32_t sf = 3; sf < cfg.SIMULATION_PERIOD_SF; sf++) {
+        frame = requestFrame(0, sf);
+        ASSERT_EQ(inbox.add(frame.data(), frame.size()), 0);
+    }
+    EXPECT_TRUE(inbox.done());
+    inbox.closeBefore(cfg.SIMULATION_PERIOD_SF);
+    EXPECT_EQ(metrics.missed_batches.count(), 1);
+    EXPECT_EQ(metrics.late_batches.count(), 0);
+}
+
+// Quantiles of the log-linear histogram are within its 1/16 bucket width
+TEST_F(SchedulerTest, LatencyHistogramQuantilesTest) {
+    LatencyHistogram histogram("test");
+    EXPECT_EQ(histogram.quantile(0.5), 0);
+    for (uint64_t us = 1; us <= 1000; us++) histogram.record(us * 1000);
+    EXPECT_EQ(histogram.count(), 1000);
+    EXPECT_EQ(histogram.max(), 1000000);
+    EXPECT_NEAR(histogram.quantile(0.5), 500000, 500000 / 16);
+    EXPECT_NEAR(histogram.quantile(0.99), 990000, 990000 / 16);
+    EXPECT_EQ(histogram.quantile(1.0), 1000000);
+    histogram.record(7, 3000);
+    EXPECT_EQ(histogram.quantile(0.5), 7);
+}
+
+// Summaries of disjoint UE tables merge into the summary of one table of all of them
+TEST_F(SchedulerTest, UeDelayTableMergeTest) {
+    UeDelayTable all(4, 10), low(2, 10), high(2, 10);
+    const std::vector<std::pair<uint32_t, unsigned>> successes{{0, 1}, {1, 2}, {0, 5}, {2, 3}, {0, 9}, {1, 20}, {3, 4}, {2, 6}};
+    for (auto [ue, sf] : successes) {
+        all.success(ue, sf);
+        if (ue < 2) low.success(ue, sf); else high.success(ue - 2, sf);
+    }
+    DelaySummary merged = low.summary(30);
+    merged.merge(high.summary(30));
+    const DelaySummary expected = all.summary(30);
+    EXPECT_EQ(merged.ues, 4);
+    EXPECT_EQ(merged.served_ues, expected.served_ues);
+    EXPECT_EQ(merged.unservedUes(), 1);                     // UE 3 succeeded once
+    EXPECT_DOUBLE_EQ(merged.avgDelay(), (4.0 + 18.0 + 3.0) / 3);
+    EXPECT_DOUBLE_EQ(merged.avgDelay(), expected.avgDelay());
+    EXPECT_EQ(merged.starved_delays, 1);                    // UE 1 waited 18 subframes
+    EXPECT_EQ(merged.starving_ues, 3);                      // all but UE 1 went the last 10 subframes without success
+    EXPECT_EQ(merged.delays.count(), 4);
+    EXPECT_EQ(merged.delays.quantile(0.5), expected.delays.quantile(0.5));
+    EXPECT_EQ(merged.delays.quantile(0.5), 4);
+    EXPECT_EQ(merged.delays.quantile(1.0), 18);
+}
+
+// A recorded trace maps back to the same batches, a truncated one is rejected
+TEST_F(SchedulerTest, TraceRoundTripTest) {
+    const std::string path = ::testing::TempDir() + "enbsim_trace_test.bin";
+    const std::vector<ResourceRequest> first{{0, ResourceType::UL, 5}, {1, ResourceType::DL, 7}};
+    const std::vector<ResourceRequest> second{{17, ResourceType::DL, 3}};
+    {
+        TraceWriter writer;
+        writer.open(path);
+        writer.record(0, 0, {first.data(), first.size()});
+        writer.record(1, 0, {nullptr, 0});
+        writer.record(1, 1, {second.data(), second.size()});
+    }
+    {
+        const TraceReader trace(path);
+        EXPECT_EQ(trace.cells(), 2);
+        EXPECT_EQ(trace.numRecords(), 3);
+        ASSERT_EQ(trace.batches().size(), 3);
+        EXPECT_EQ(trace.batches()[1].cell_id, 1);
+        EXPECT_EQ(trace.records(trace.batches()[1]).size(), 0);
+        EXPECT_EQ(trace.batches()[2].subframe, 1);
+        const auto replayed = trace.records(trace.batches()[2]);
+        ASSERT_EQ(replayed.size(), 1);
+        EXPECT_EQ(replayed[0].ue_id, 17);
+        EXPECT_EQ(replayed[0].resource_type, ResourceType::DL);
+        EXPECT_EQ(replayed[0].data_length, 3);
+        EXPECT_EQ(trace.records(trace.batches()[0])[1].data_length, 7);
+    }
+    const auto expectCorruptHeader = [&path](auto change) {
+        TraceHeader header;
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        const TraceHeader original = header;
+        change(header);
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.flush();
+        EXPECT_THROW(TraceReader{path}, std::runtime_error);
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&original), sizeof(original));
+    };
+    expectCorruptHeader([](TraceHeader& header) { header.index_offset = sizeof(TraceHeader); });   // index overlaps the records
+    expectCorruptHeader([](TraceHeader& header) { header.cells = TRACE_MAX_CELLS + 1; });
+    EXPECT_NO_THROW(TraceReader{path});
+    ASSERT_EQ(truncate(path.c_str(), sizeof(TraceHeader) + 8), 0);
+    EXPECT_THROW(TraceReader{path}, std::runtime_error);
+    std::remove(path.c_str());
+}
+
+// Records of threads that exit right after logging are printed once each, none is lost with the ring
+TEST_F(SchedulerTest, AsyncLogExitedThreadsTest) {
+    constexpr unsigned THREADS = 64;
+    testing::internal::CaptureStdout();
+    {
+        AsyncLog log;
+        for (unsigned i = 0; i < THREADS; i++) {
+            std::thread([&log, i]() {
+                log.write({LogEvent::SUBFRAME, ResourceType::UL, AllocationStatus::SUCCESS, 0, LogRecord::NO_CELL, i, 0, 0, 0});
+            }).join();
+            if (i % 2) log.flush();
+        }
+    }
+    const std::string out = testing::internal::GetCapturedStdout();
+    for (unsigned i = 0; i < THREADS; i++) {
+        const std::string line = "subframe " + std::to_string(i) + "\n";
+        const auto first = out.find(line);
+        ASSERT_NE(first, std::string::npos) << line;
+        EXPECT_EQ(out.find(line, first + 1), std::string::npos) << line;
+    }
+}
+
+// A sweep point without requests still writes valid JSON: ratios it cannot compute are null
+TEST_F(SchedulerTest, SweepJsonEmptyPointTest) {
+    Configuration cfg;
+    cfg.M = 0;
+    cfg.SIMULATION_PERIOD_SF = 20;
+    const std::vector<SweepAxis> axes{{"M", {"0"}}};
+    const std::vector<SweepPoint> points{{{"0"}, cfg}, {{"0"}, cfg}};
+    std::vector<SweepResult> results{simulatePoint(cfg), SweepResult{}};
+    results[1].success_rate = std::nan("");
+    results[1].ul_utilization = std::numeric_limits<double>::infinity();
+    std::ostringstream json;
+    writeJson(json, axes, points, results);
+    EXPECT_EQ(json.str().find("nan"), std::string::npos) << json.str();
+    EXPECT_EQ(json.str().find("inf"), std::string::npos) << json.str();
+    EXPECT_NE(json.str().find("\"success_rate\": null"), std::string::npos) << json.str();
+    EXPECT_NE(json.str().find("\"ul_utilization\": null"), std::string::npos) << json.str();
+}
+
+// K follows L until it is set, unknown keys and bad values are reported
+TEST_F(SchedulerTest, ConfigurationSetTest) {
+    Configuration cfg;
+    EXPECT_EQ(cfg.K, 10 * cfg.L);
+    EXPECT_TRUE(cfg.set("L", "26"));
+    EXPECT_EQ(cfg.K, 260);
+    EXPECT_TRUE(cfg.set("K", "100"));
+    EXPECT_TRUE(cfg.set("L", "4"));
+    EXPECT_EQ(cfg.K, 100);
+    EXPECT_TRUE(cfg.set("K", "0"));
+    EXPECT_EQ(cfg.K, 40);
+    EXPECT_TRUE(cfg.set("SF_TIME_SCALE", "0.125"));
+    EXPECT_EQ(cfg.SF_TIME_SCALE, std::chrono::microseconds(125));
+    EXPECT_FALSE(cfg.set("NO_SUCH_KEY", "1"));
+    EXPECT_THROW(cfg.set("UE_MODE", "SIDEWAYS"), std::range_error);
+    EXPECT_THROW(cfg.set("PACING_SPIN_US", "-5"), std::range_error);
+    EXPECT_THROW(cfg.set("SIMULATION_PERIOD_SF", "0"), std::range_error);
+    EXPECT_THROW(cfg.set("N", "65535"), std::range_error);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
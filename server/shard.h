@@ -0,0 +1,331 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+#include <chrono>
+#include <iostream>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "cell.h"
+#include "../cell_datagrams.h"
+
+/* Sharding: worker w of S owns the cells with cell_id % S == w and binds its
+ * own SO_REUSEPORT socket on PORT. A classic BPF program attached to the
+ * reuseport group steers every datagram to socket cell_id % S, so cells never
+ * migrate and workers share no mutable state.
+ */
+
+// Request frames in flight, keeps loopback socket buffers from overflowing
+constexpr unsigned UDP_WINDOW = 64;
+
+inline unsigned shardCount(const Configuration& cfg) {
+    const unsigned shards = cfg.SHARDS ? cfg.SHARDS : std::max(1U, std::thread::hardware_concurrency());
+    return std::min(shards, cfg.CELLS);
+}
+
+inline void pinToCore(unsigned core) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core % std::max(1U, std::thread::hardware_concurrency()), &cpus);
+    const int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err) std::cerr << "cannot pin shard to core " << core << ": " << strerror(err) << '\n';
+}
+
+/* Selects socket cell_id % shards of the reuseport group, sockets are numbered
+ * in bind order. The program sees the UDP payload, cell_id is little-endian.
+ */
+inline void attachCellSteering(int sockfd, unsigned shards) {
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 3),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 2),
+        BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 1),
+        BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+        BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, shards),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_fprog prog = {static_cast<unsigned short>(std::size(code)), code};
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        throw std::system_error(errno, std::generic_category(), "SO_ATTACH_REUSEPORT_CBPF");
+    }
+}
+
+// One socket per shard, all bound to servaddr
+inline std::vector<int> openShardSockets(const struct sockaddr_in& servaddr, unsigned shards) {
+    std::vector<int> sockets;
+    for (unsigned w = 0; w < shards; w++) {
+        const int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sockfd < 0) throw std::system_error(errno, std::generic_category(), "socket creation failed");
+        const int on = 1;
+        if (shards > 1 && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+            throw std::system_error(errno, std::generic_category(), "SO_REUSEPORT");
+        }
+        if (setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0) {
+            throw std::system_error(errno, std::generic_category(), "SO_RXQ_OVFL");
+        }
+        if (bind(sockfd, reinterpret_cast<const struct sockaddr *>(&servaddr), sizeof(servaddr)) < 0) {
+            throw std::system_error(errno, std::generic_category(), "bind failed");
+        }
+        sockets.push_back(sockfd);
+    }
+    if (shards > 1) attachCellSteering(sockets.front(), shards);
+    return sockets;
+}
+
+// When a shard handled its first and last batch
+struct ShardTiming {
+    std::chrono::steady_clock::time_point first{};
+    std::chrono::steady_clock::time_point last{};
+};
+
+/* Waits on a shard's socket and, unless VIRTUAL_TIME is set, on a timerfd
+ * ticking every SF_TIME_SCALE once the first frame arrived. Virtual time has
+ * no deadlines. Either way the shard gives up when no frame came for
+ * IDLE_TIMEOUT, so a client that went away does not keep it waiting.
+ */
+class ShardEvents {
+    static constexpr int IDLE_TIMEOUT_MS = 2000;
+
+    int epfd_;
+    int timerfd_ = -1;
+    std::chrono::nanoseconds tti_;
+    bool started_ = false;
+    uint64_t last_frame_ns_ = 0;
+
+    void watch(int fd) {
+        struct epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &event) < 0) throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+    }
+
+  public:
+    ShardEvents(const Configuration& cfg, int sockfd) : epfd_(epoll_create1(EPOLL_CLOEXEC)), tti_(cfg.SF_TIME_SCALE) {
+        if (epfd_ < 0) throw std::system_error(errno, std::generic_category(), "epoll_create1");
+        watch(sockfd);
+        if (cfg.VIRTUAL_TIME) return;
+        timerfd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (timerfd_ < 0) throw std::system_error(errno, std::generic_category(), "timerfd_create");
+        watch(timerfd_);
+    }
+
+    ~ShardEvents() {
+        if (timerfd_ >= 0) close(timerfd_);
+        close(epfd_);
+    }
+
+    ShardEvents(const ShardEvents&) = delete;
+    ShardEvents& operator = (const ShardEvents&) = delete;
+
+    // Frames arrived: starts the subframe clock the first time and returns true then
+    bool received() {
+        last_frame_ns_ = monotonicNs();
+        if (started_) return false;
+        started_ = true;
+        if (timerfd_ >= 0) {
+            struct itimerspec period{};
+            period.it_interval.tv_sec = tti_.count() / 1000000000;
+            period.it_interval.tv_nsec = tti_.count() % 1000000000;
+            period.it_value = period.it_interval;
+            if (timerfd_settime(timerfd_, 0, &period, nullptr) < 0) throw std::system_error(errno, std::generic_category(), "timerfd_settime");
+        }
+        return true;
+    }
+
+    /* Waits until frames are waiting or the clock ticked, ticks receives the
+     * ticks since the last call. Returns false once no frame came for the idle
+     * timeout and none is waiting: frames that come late still get handled.
+     */
+    bool wait(uint64_t& ticks, bool& readable) {
+        struct epoll_event events[2];
+        const int timeout = started_ ? IDLE_TIMEOUT_MS : -1;
+        int ready;
+        while ((ready = epoll_wait(epfd_, events, 2, timeout)) < 0 && errno == EINTR) {}
+        if (ready < 0) {
+            std::cerr << "epoll_wait error " << errno << ": " << strerror(errno) << '\n';
+            return false;
+        }
+        ticks = 0;
+        readable = false;
+        for (int i = 0; i < ready; i++) {
+            uint64_t expirations;
+            if (events[i].data.fd != timerfd_) readable = true;
+            else if (read(timerfd_, &expirations, sizeof(expirations)) == sizeof(expirations)) ticks += expirations;
+        }
+        if (readable) return true;
+        return ready > 0 && (!started_ || monotonicNs() - last_frame_ns_ <= IDLE_TIMEOUT_MS * 1000000ULL);
+    }
+};
+
+/* Reassembles the request batches of a shard's cells from their frames and
+ * keeps their deadlines. Counting clock ticks from the first frame, whose
+ * subframe was due in the first one, a batch is due in the tick of its
+ * subframe and late once DEADLINE_GRACE more ticks have passed: it is
+ * counted as missed then, and answered with failures if it still completes.
+ * A batch the assembler skipped for a newer one is missed as soon as that
+ * one completes. Every subframe of a cell is missed at most once.
+ * A cell is done once the batch of its last subframe completed, late or not.
+ */
+template <typename Sched>
+class ShardInbox {
+    static constexpr uint64_t DEADLINE_GRACE = 1;
+
+    const Configuration& cfg_;
+    const std::vector<Cell<Sched>>& cells_;
+    unsigned shards_;
+    ServerMetrics& metrics_;
+    std::vector<BatchAssembler<ResourceRequest>> assemblers_;
+    std::vector<uint32_t> closed_;  // per cell, earlier subframes were scheduled, late or missed
+    std::size_t cells_left_;
+    bool started_ = false;
+    uint32_t first_sf_ = 0;
+    uint64_t ticks_ = 0;
+    uint32_t deadline_sf_ = 0;      // batches of earlier subframes are late
+
+    void reject(const char* reason, uint32_t cell_id) {
+        metrics_.rejected_frames.add();
+        if (reason) std::cerr << reason << " for cell " << cell_id << "\n";
+    }
+
+  public:
+    static constexpr uint32_t NO_CELL = ~0U;
+
+    ShardInbox(const Configuration& cfg, const std::vector<Cell<Sched>>& cells, unsigned shards, ServerMetrics& metrics = server_metrics)
+      : cfg_(cfg),
+        cells_(cells),
+        shards_(shards),
+        metrics_(metrics),
+        assemblers_(cells.size()),
+        closed_(cells.size()),
+        cells_left_(cells.size()) {
+    }
+
+    bool done() const { return cells_left_ == 0; }
+
+    // Subframes before sf are over, cells without their batch have missed it
+    void closeBefore(uint32_t sf) {
+        sf = std::min(sf, cfg_.SIMULATION_PERIOD_SF);
+        if (sf <= deadline_sf_) return;
+        for (auto& closed : closed_) {
+            if (closed >= sf) continue;
+            metrics_.missed_batches.add(sf - closed);
+            closed = sf;
+        }
+        deadline_sf_ = sf;
+    }
+
+    void tick(uint64_t ticks) {
+        if (!started_ || !ticks) return;
+        ticks_ += ticks;
+        if (ticks_ > DEADLINE_GRACE) closeBefore(first_sf_ + (ticks_ - DEADLINE_GRACE));
+    }
+
+    // Adds a received frame, returns the index of the cell whose batch it completed or NO_CELL
+    uint32_t add(const uint8_t* data, std::size_t len) {
+        FrameHeader header;
+        if (!parseFrame(data, len, FrameKind::REQUESTS, header)) {
+            std::cerr << "received " << len << " bytes, not a request frame\n";
+            metrics_.rejected_frames.add();
+            return NO_CELL;
+        }
+        const uint32_t index = header.cell_id / shards_;
+        if (header.cell_id % shards_ != cells_.front().id() % shards_ || index >= cells_.size()
+            || header.subframe >= cfg_.SIMULATION_PERIOD_SF) {
+            reject("Unexpected batch", header.cell_id);
+            return NO_CELL;
+        }
+        if (!started_) {
+            started_ = true;
+            first_sf_ = header.subframe;
+        }
+        const Reassembly result = assemblers_[index].add(header, data, len);
+        if (result == Reassembly::MALFORMED) reject("Malformed frame", header.cell_id);
+        if (result == Reassembly::STALE) reject(nullptr, header.cell_id);
+        if (result != Reassembly::COMPLETE) return NO_CELL;
+        uint32_t& closed = closed_[index];
+        if (closed < header.subframe) metrics_.missed_batches.add(header.subframe - closed);
+        closed = std::max(closed, header.subframe + 1);
+        if (late(index)) metrics_.late_batches.add();
+        if (header.subframe + 1 == cfg_.SIMULATION_PERIOD_SF) cells_left_--;
+        return index;
+    }
+
+    BatchAssembler<ResourceRequest>& batch(uint32_t index) { return assemblers_[index]; }
+
+    // The complete batch of cell index came after its deadline
+    bool late(uint32_t index) const { return assemblers_[index].subframe() < deadline_sf_; }
+};
+
+/* Every cell sends its batch of a subframe, empty or not, in one or more
+ * frames and gets its responses back the same way. The shard sleeps in
+ * epoll_wait until frames arrive or the subframe clock ticks (ShardEvents),
+ * then drains the socket with recvmmsg and answers with sendmmsg, so
+ * syscalls per subframe do not grow with the cell count. A cell schedules
+ * each batch in the subframe of its header: a lost batch is skipped rather
+ * than shifting every later one, a late one fails. cells holds the shard's
+ * cells, cell_id / shards is the index of a cell; metrics are the shard's own.
+ */
+template <typename Sched>
+ShardTiming runShard(const Configuration& cfg, int sockfd, std::vector<Cell<Sched>>& cells, unsigned shards, ServerMetrics& metrics) {
+    CellDatagrams requests(UDP_WINDOW);
+    CellDatagrams responses(UDP_WINDOW);
+    ShardInbox<Sched> inbox(cfg, cells, shards, metrics);
+    ShardEvents events(cfg, sockfd);
+    std::vector<SchedulerResponse> out(cfg.M);
+    ShardTiming timing;
+    uint32_t socket_drops = 0;
+
+    while (!inbox.done()) {
+        const uint64_t wait_start = monotonicNs();
+        uint64_t ticks;
+        bool readable;
+        if (!events.wait(ticks, readable)) break;
+        metrics.receive_wait.recordSince(wait_start);
+        inbox.tick(ticks);
+        for (unsigned received = readable ? requests.slots() : 0; received == requests.slots(); ) {
+            received = requests.receive(sockfd, requests.slots(), MSG_DONTWAIT);
+            if (received == requests.slots()) metrics.full_receives.add();
+            if (received && events.received()) timing.first = std::chrono::steady_clock::now();
+            for (unsigned i = 0; i < received; i++) {
+                const uint32_t index = inbox.add(requests.data(i), requests.length(i));
+                if (index == ShardInbox<Sched>::NO_CELL) continue;
+                const auto& batch = inbox.batch(index);
+                if (out.size() < batch.records().size()) out.resize(batch.records().size());
+                const unsigned num_responses = inbox.late(index) ? cells[index].reject(batch.records(), out.data())
+                                                                 : cells[index].schedule(batch.subframe(), batch.records(), out.data());
+                responses.queue(sockfd, cells[index].id(), batch.subframe(), Span<const SchedulerResponse>{out.data(), num_responses},
+                                requests.address(i));
+            }
+            const uint64_t send_start = monotonicNs();
+            responses.flush(sockfd);
+            metrics.send.recordSince(send_start);
+        }
+        metrics.socket_drops.add(requests.socketDrops() - socket_drops);
+        socket_drops = requests.socketDrops();
+    }
+    inbox.closeBefore(cfg.SIMULATION_PERIOD_SF);
+    timing.last = std::chrono::steady_clock::now();
+    return timing;
+}
@@ -0,0 +1,87 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+
+/* Scaling report of the sharded server: cell subframes scheduled per second
+ * with 1, 2, 4 ... cores. Every shard thread is pinned and owns its cells as
+ * in the server; batches are generated in memory so the socket path and the
+ * client do not limit the result.
+ *
+ * usage: shard_scaling [cells] [subframes] [max shards]
+ */
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "shard.h"
+
+namespace {
+
+// Every UE of a cell requests in every subframe, mixed directions and lengths
+std::vector<ResourceRequest> saturatedBatch(const Configuration& cfg, uint32_t cell_id) {
+    std::mt19937 rng(cell_id);
+    std::vector<ResourceRequest> batch;
+    for (uint32_t ue = 0; ue < cfg.M; ue++) {
+        const auto type = rng() % 2 ? ResourceType::UL : ResourceType::DL;
+        const auto len = rng() % 100 < cfg.SHORT_SHARE ? cfg.SHORT_L : cfg.L;
+        batch.push_back({cell_id * cfg.M + ue, type, static_cast<uint16_t>(len)});
+    }
+    return batch;
+}
+
+double cellSubframesPerSec(const Configuration& cfg, unsigned cells, unsigned subframes, unsigned shards) {
+    std::promise<void> start;
+    std::shared_future<void> started = start.get_future().share();
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < shards; w++) {
+        workers.emplace_back([=, &cfg]() {
+            pinToCore(w);
+            std::vector<Cell<Scheduler>> owned;
+            std::vector<std::vector<ResourceRequest>> batches;
+            for (uint32_t id = w; id < cells; id += shards) {
+                owned.emplace_back(cfg, id);
+                batches.push_back(saturatedBatch(cfg, id));
+            }
+            std::vector<SchedulerResponse> responses(cfg.M);
+            started.wait();
+            for (unsigned sf = 0; sf < subframes; sf++) {
+                for (unsigned i = 0; i < owned.size(); i++) {
+                    owned[i].schedule({batches[i].data(), batches[i].size()}, responses.data());
+                }
+            }
+        });
+    }
+    const auto begin = std::chrono::steady_clock::now();
+    start.set_value();
+    for (auto& worker : workers) worker.join();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return uint64_t{cells} * subframes / seconds;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const unsigned cells = argc > 1 ? std::stoul(argv[1]) : 256;
+    const unsigned subframes = argc > 2 ? std::stoul(argv[2]) : 2000;
+    const unsigned max_shards = argc > 3 ? std::stoul(argv[3]) : std::max(1U, std::thread::hardware_concurrency());
+    Configuration cfg = Configuration::load();
+    cfg.DEBUGPRINTS = false;
+
+    std::cout << cells << " cells, " << subframes << " subframes, M=" << cfg.M << " N=" << cfg.N << " L=" << cfg.L << "\n";
+    std::cout << std::setw(8) << "shards" << std::setw(22) << "cell subframes/sec" << std::setw(10) << "speedup" << "\n";
+    double single = 0;
+    for (unsigned shards = 1; ; shards = std::min(2 * shards, max_shards)) {
+        const double rate = cellSubframesPerSec(cfg, cells, subframes, std::min(shards, cells));
+        if (shards == 1) single = rate;
+        std::cout << std::setw(8) << shards << std::setw(22) << std::fixed << std::setprecision(0) << rate
+                  << std::setw(10) << std::setprecision(2) << rate / single << "\n";
+        if (shards == max_shards) break;
+    }
+    return 0;
+}
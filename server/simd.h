@@ -0,0 +1,61 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* Vector kernels over arrays of unsigned counters: AVX2 when the compiler
+ * targets it (ENBSIM_NATIVE_ARCH), SSE2 on any x86-64, scalar otherwise.
+ * Counters are compared as signed 32-bit values, they never get near 2^31.
+ */
+
+// Index of the first counter below limit in [0, n), n if there is none
+inline unsigned findBelow(const unsigned* counters, unsigned n, unsigned limit) {
+    unsigned i = 0;
+#if defined(__AVX2__)
+    const __m256i lim = _mm256_set1_epi32(static_cast<int>(limit));
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counters + i));
+        const unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(lim, v)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#elif defined(__SSE2__)
+    const __m128i lim = _mm_set1_epi32(static_cast<int>(limit));
+    for (; i + 4 <= n; i += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(counters + i));
+        const unsigned mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(lim, v)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < n; i++) {
+        if (counters[i] < limit) return i;
+    }
+    return n;
+}
+
+// Adds val to every counter in [0, n)
+inline void addTo(unsigned* counters, unsigned n, unsigned val) {
+    if (val == 0) return;
+    unsigned i = 0;
+#if defined(__AVX2__)
+    const __m256i inc = _mm256_set1_epi32(static_cast<int>(val));
+    for (; i + 8 <= n; i += 8) {
+        __m256i* p = reinterpret_cast<__m256i*>(counters + i);
+        _mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), inc));
+    }
+#elif defined(__SSE2__)
+    const __m128i inc = _mm_set1_epi32(static_cast<int>(val));
+    for (; i + 4 <= n; i += 4) {
+        __m128i* p = reinterpret_cast<__m128i*>(counters + i);
+        _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), inc));
+    }
+#endif
+    for (; i < n; i++) counters[i] += val;
+}
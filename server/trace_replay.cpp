@@ -0,0 +1,87 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+
+/* Re-schedules a trace recorded with TRACE_RECORD at full speed, without
+ * sockets, threads or a client. K, N and the packing policy come from
+ * enbsim.cfg, so the same trace can compare engines and scheduler versions.
+ *
+ * usage: trace_replay <trace> [LINEAR|INDEXED|BITMAP]
+ */
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "cell.h"
+#include "scheduler_profiles.h"
+
+namespace {
+
+template <typename Sched>
+void replay(const Configuration& cfg, const TraceReader& trace) {
+    std::vector<Cell<Sched>> cells;
+    for (uint32_t id = 0; id < trace.cells(); id++) cells.emplace_back(cfg, id);
+    std::vector<SchedulerResponse> responses;
+
+    uint64_t out_of_order = 0;
+    const auto begin = std::chrono::steady_clock::now();
+    for (const auto& batch : trace.batches()) {
+        auto& cell = cells.at(batch.cell_id);
+        if (cell.currentSubframe() != batch.subframe) out_of_order++;
+        const Span<const ResourceRequest> requests = trace.records(batch);
+        if (responses.size() < requests.size()) responses.resize(requests.size());
+        cell.schedule(requests, responses.data());
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    unsigned success = 0;
+    unsigned total = 0;
+    double ul_blk_per_sf = 0;
+    double dl_blk_per_sf = 0;
+    for (auto& cell : cells) {
+        success += cell.uplink.success + cell.downlink.success;
+        total += cell.uplink.total + cell.downlink.total;
+        if (cell.currentSubframe() == 0) continue;
+        ul_blk_per_sf += cell.uplink.avgBlockPerSf(0, cell.currentSubframe() - 1) / cells.size();
+        dl_blk_per_sf += cell.downlink.avgBlockPerSf(0, cell.currentSubframe() - 1) / cells.size();
+    }
+    if (out_of_order) std::cerr << out_of_order << " batches out of subframe order\n";
+    std::cout << "Batches: " << trace.batches().size() << ", requests: " << trace.numRecords() << ", cells: " << cells.size() << "\n";
+    std::cout << "Success rate: " << 100.0 * success / std::max(1U, total) << "%\n";
+    std::cout << "Uplink utilization: " << 100.0 * ul_blk_per_sf / cfg.N << " %\n";
+    std::cout << "Downlink utilization: " << 100.0 * dl_blk_per_sf / cfg.N << " %\n";
+    std::cout << "Replay time: " << seconds * 1000 << "ms, " << trace.batches().size() / seconds << " cell subframes/sec\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <trace> [LINEAR|INDEXED|BITMAP]\n";
+        return EXIT_FAILURE;
+    }
+    Configuration cfg = Configuration::load();
+    cfg.DEBUGPRINTS = false;
+    const std::string engine = argc > 2 ? argv[2] : "";
+    try {
+        const TraceReader trace(argv[1]);
+        if (engine == "LINEAR" || (engine.empty() && cfg.SCHEDULER_ENGINE == SchedulerEngine::LINEAR)) {
+            withLinearScheduler(cfg, [&](auto sched) { replay<typename decltype(sched)::type>(cfg, trace); });
+        } else if (engine == "INDEXED" || (engine.empty() && cfg.SCHEDULER_ENGINE == SchedulerEngine::INDEXED)) {
+            replay<IndexedScheduler>(cfg, trace);
+        } else if (engine == "BITMAP" || (engine.empty() && cfg.SCHEDULER_ENGINE == SchedulerEngine::BITMAP)) {
+            replay<BitmapScheduler>(cfg, trace);
+        } else {
+            std::cerr << "unknown engine " << engine << "\n";
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+/* Helpers shared by reservation windows. A window keeps per-subframe state for
+ * the K-subframe lookahead in a ring indexed by absolute subframe number:
+ *   load(sf)                               - blocks reserved in subframe sf
+ *   retire(sf)                             - clears the ring slot of sf, returns its load
+ *   reserve(from, to, data_len, num, out)  - first-fit runs of data_len inside [from, to),
+ *                                            out (if not null) receives one Allocation per run
+ *   sum(from, to)                          - blocks reserved in [from, to)
+ * Runs of different lengths are placed one by one, a run fits only where every
+ * subframe it covers has a free block:
+ *   findFit(from, to, len)                 - first subframe in [from, to) a run fits at, to if none
+ *   runCapacity(sf, len)                   - number of runs that would still fit at sf
+ *   place(sf, len)                         - reserves one fitting run at sf
+ * Reserved runs can be changed afterwards:
+ *   adjust(run, from, to, delta)           - adds delta (1 or -1) blocks of run to [from, to)
+ *   extendable(run, from, to)              - whether run's block is free in all of [from, to)
+ */
+
+// Placement of one reserved run: first subframe and resource block
+struct Allocation {
+    static constexpr unsigned NO_RB = ~0U;        // engine does not track frequency channels
+    static constexpr unsigned NO_SUBFRAME = ~0U;  // request was not allocated
+    unsigned subframe;
+    unsigned rb;
+};
+
+constexpr unsigned ringSize(unsigned window_len) {
+    unsigned size = 1;
+    while (size < window_len) size <<= 1;
+    return size;
+}
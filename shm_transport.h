@@ -0,0 +1,247 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "futex.h"
+#include "lockfree_ring.h"
+
+constexpr char SHM_NAME[] = "/enbsim";
+constexpr uint32_t SHM_MAGIC = 0x656e6273;  // "enbs"
+constexpr uint32_t SHM_RING_DEPTH = 4;      // batches in flight per direction
+constexpr unsigned SHM_SPIN_LIMIT = 256;    // polls before sleeping on the futex
+
+/* Single-producer single-consumer ring of batches living in shared memory.
+ * The producer fills a slot in place and publishes it with its record count,
+ * the consumer reads the slot in place and releases it. Each side sleeps on
+ * the other side's index as a process-shared futex.
+ */
+template <typename T>
+class ShmRing {
+  public:
+    struct Control {
+        alignas(CACHE_LINE) std::atomic<uint32_t> head;  // batches published
+        std::atomic<uint32_t> consumer_sleeping;
+        alignas(CACHE_LINE) std::atomic<uint32_t> tail;  // batches released
+        std::atomic<uint32_t> producer_sleeping;
+        uint32_t counts[SHM_RING_DEPTH];
+    };
+
+  private:
+    Control* ctl_;
+    T* items_;
+    uint32_t capacity_;
+
+    // Waits until ready() holds, sleeping on word which the other side bumps
+    template <typename Ready>
+    static void await(std::atomic<uint32_t>& word, std::atomic<uint32_t>& sleeping, Ready ready) {
+        for (unsigned spin = 0; spin < SHM_SPIN_LIMIT; spin++) {
+            if (ready()) return;
+        }
+        while (true) {
+            const uint32_t seen = word.load();
+            sleeping.store(1);
+            if (ready()) return;
+            futexWait(word, seen, true);
+        }
+    }
+
+    static void notify(std::atomic<uint32_t>& word, std::atomic<uint32_t>& sleeping) {
+        if (sleeping.load() && sleeping.exchange(0)) futexWake(word, true);
+    }
+
+    T* slot(uint32_t batch) const { return items_ + (batch % SHM_RING_DEPTH) * capacity_; }
+
+  public:
+    ShmRing(Control* ctl, T* items, uint32_t capacity) : ctl_(ctl), items_(items), capacity_(capacity) {}
+
+    uint32_t capacity() const { return capacity_; }
+
+    // Producer: waits for a free slot of capacity() records
+    T* acquire() {
+        const uint32_t head = ctl_->head.load(std::memory_order_relaxed);
+        await(ctl_->tail, ctl_->producer_sleeping, [this, head]() { return head - ctl_->tail.load() < SHM_RING_DEPTH; });
+        return slot(head);
+    }
+
+    // Producer: hands the first count records of the acquired slot to the consumer
+    void publish(uint32_t count) {
+        const uint32_t head = ctl_->head.load(std::memory_order_relaxed);
+        ctl_->counts[head % SHM_RING_DEPTH] = count;
+        ctl_->head.store(head + 1);
+        notify(ctl_->head, ctl_->consumer_sleeping);
+    }
+
+    // Consumer: waits for the next batch, valid until release()
+    Span<const T> peek() {
+        const uint32_t tail = ctl_->tail.load(std::memory_order_relaxed);
+        await(ctl_->head, ctl_->consumer_sleeping, [this, tail]() { return ctl_->head.load() != tail; });
+        return {slot(tail), ctl_->counts[tail % SHM_RING_DEPTH]};
+    }
+
+    void release() {
+        ctl_->tail.store(ctl_->tail.load(std::memory_order_relaxed) + 1);
+        notify(ctl_->tail, ctl_->producer_sleeping);
+    }
+};
+
+enum class ShmRole {
+    SERVER,     // creates the segment, consumes requests and produces responses
+    CLIENT      // attaches to the server's segment
+};
+
+/* Request and response rings in one POSIX shared-memory segment. The server
+ * reads requests and writes responses in place, the client copies its
+ * batches in and out with memcpy instead of going through the kernel.
+ */
+class ShmTransport {
+    struct Header {
+        std::atomic<uint32_t> magic;    // set once the server initialised the segment
+        uint32_t capacity;              // records per batch
+        ShmRing<ResourceRequest>::Control requests;
+        ShmRing<SchedulerResponse>::Control responses;
+    };
+
+    ShmRole role_;
+    int fd_ = -1;
+    std::size_t size_ = 0;
+    void* map_ = nullptr;
+    ShmRing<ResourceRequest> requests_{nullptr, nullptr, 0};
+    ShmRing<SchedulerResponse> responses_{nullptr, nullptr, 0};
+
+    static std::size_t segmentSize(uint32_t capacity) {
+        return sizeof(Header) + SHM_RING_DEPTH * capacity * (sizeof(ResourceRequest) + sizeof(SchedulerResponse));
+    }
+
+    void map(std::size_t size) {
+        size_ = size;
+        map_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (map_ == MAP_FAILED) {
+            map_ = nullptr;
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        }
+    }
+
+    void bindRings(Header* header) {
+        auto* request_items = reinterpret_cast<ResourceRequest*>(header + 1);
+        auto* response_items = reinterpret_cast<SchedulerResponse*>(request_items + SHM_RING_DEPTH * header->capacity);
+        requests_ = {&header->requests, request_items, header->capacity};
+        responses_ = {&header->responses, response_items, header->capacity};
+    }
+
+    void create(uint32_t capacity) {
+        shm_unlink(SHM_NAME);  // left behind by a crashed run
+        fd_ = shm_open(SHM_NAME, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "shm_open");
+        if (ftruncate(fd_, segmentSize(capacity)) < 0) throw std::system_error(errno, std::generic_category(), "ftruncate");
+        map(segmentSize(capacity));
+        auto* header = new (map_) Header{};
+        header->capacity = capacity;
+        bindRings(header);
+        header->magic.store(SHM_MAGIC);
+    }
+
+    /* Waits for the server to create and initialise the segment. The server
+     * sizes it after opening it, mapping it before would fault on access.
+     */
+    void attach(uint32_t capacity) {
+        constexpr auto RETRY = std::chrono::milliseconds(10);
+        constexpr unsigned MAX_RETRIES = 500;
+        for (unsigned retry = 0; fd_ < 0; retry++) {
+            fd_ = shm_open(SHM_NAME, O_RDWR, 0);
+            if (fd_ < 0 && (errno != ENOENT || retry == MAX_RETRIES)) {
+                throw std::system_error(errno, std::generic_category(), "shm_open");
+            }
+            if (fd_ < 0) std::this_thread::sleep_for(RETRY);
+        }
+        for (unsigned retry = 0; ; retry++) {
+            struct stat st{};
+            if (fstat(fd_, &st) < 0) throw std::system_error(errno, std::generic_category(), "fstat");
+            if (static_cast<std::size_t>(st.st_size) >= sizeof(Header)) break;
+            if (retry == MAX_RETRIES) throw std::runtime_error("shared memory segment was not sized");
+            std::this_thread::sleep_for(RETRY);
+        }
+        map(sizeof(Header));
+        auto* header = static_cast<Header*>(map_);
+        for (unsigned retry = 0; header->magic.load() != SHM_MAGIC; retry++) {
+            if (retry == MAX_RETRIES) throw std::runtime_error("shared memory segment was not initialised");
+            std::this_thread::sleep_for(RETRY);
+        }
+        if (header->capacity < capacity) throw std::runtime_error("shared memory batches are smaller than M");
+        const uint32_t server_capacity = header->capacity;
+        munmap(map_, size_);
+        map(segmentSize(server_capacity));
+        bindRings(static_cast<Header*>(map_));
+    }
+
+    // Unmaps and closes the segment, the server also removes its name
+    void detach() {
+        if (map_) munmap(map_, size_);
+        if (fd_ >= 0) close(fd_);
+        if (role_ == ShmRole::SERVER) shm_unlink(SHM_NAME);
+        map_ = nullptr;
+        fd_ = -1;
+    }
+
+  public:
+    ShmTransport(ShmRole role, uint32_t capacity) : role_(role) {
+        try {
+            if (role_ == ShmRole::SERVER) create(capacity); else attach(capacity);
+        } catch (...) {
+            detach();
+            throw;
+        }
+    }
+
+    ShmTransport(const ShmTransport&) = delete;
+    ShmTransport& operator = (const ShmTransport&) = delete;
+
+    ~ShmTransport() { detach(); }
+
+    // Client: sends the subframe's requests and receives the responses, if any requests were sent
+    void exchange(const std::vector<ResourceRequest>& requests, std::vector<SchedulerResponse>& responses) {
+        const uint32_t count = std::min<std::size_t>(requests.size(), requests_.capacity());
+        if (count < requests.size()) std::cerr << "dropping " << requests.size() - count << " requests over batch capacity\n";
+        std::copy_n(requests.cbegin(), count, requests_.acquire());
+        requests_.publish(count);
+        responses.clear();
+        if (count == 0) return;
+        const Span<const SchedulerResponse> batch = responses_.peek();
+        responses.assign(batch.begin(), batch.end());
+        responses_.release();
+    }
+
+    // Server: next batch of requests, valid until respond() or skip()
+    Span<const ResourceRequest> receive() { return requests_.peek(); }
+
+    // Server: slot for the responses to the received batch
+    SchedulerResponse* responseBuffer() { return responses_.acquire(); }
+
+    // Server: publishes count responses written to responseBuffer() and releases the requests
+    void respond(std::size_t count) {
+        responses_.publish(count);
+        requests_.release();
+    }
+
+    // Server: releases a batch that gets no response
+    void skip() { requests_.release(); }
+};
@@ -0,0 +1,76 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+
+/* Parameter sweep: every point of the grid is a complete client and server
+ * simulation in virtual time, run in process on all cores. Parameters not
+ * swept come from enbsim.cfg.
+ *
+ * usage: sweep [--threads n] [--csv file] [--json file] KEY=v1,v2,... ...
+ *   e.g. sweep L=16,26 M=40,80,160 N=13,25 UE_MODE=MIXED,UPLINK_ONLY --json sweep.json
+ * The CSV table goes to stdout unless --csv or --json is given.
+ */
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "sweep.h"
+
+int main(int argc, char* argv[]) {
+    unsigned threads = std::max(1U, std::thread::hardware_concurrency());
+    std::string csv_path;
+    std::string json_path;
+    std::vector<SweepAxis> axes;
+    try {
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            if ((arg == "--threads" || arg == "--csv" || arg == "--json") && i + 1 == argc) {
+                throw std::invalid_argument(arg + " needs a value");
+            } else if (arg == "--threads") {
+                threads = std::stoul(argv[++i]);
+            } else if (arg == "--csv") {
+                csv_path = argv[++i];
+            } else if (arg == "--json") {
+                json_path = argv[++i];
+            } else {
+                axes.push_back(parseAxis(arg));
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\nusage: " << argv[0] << " [--threads n] [--csv file] [--json file] KEY=v1,v2,... ...\n";
+        return EXIT_FAILURE;
+    }
+
+    Configuration base = Configuration::load(CFG_FILE, std::cerr);
+    base.VIRTUAL_TIME = true;
+    base.DEBUGPRINTS = false;
+    base.TRACE_RECORD.clear();
+    std::vector<SweepPoint> points;
+    try {
+        points = expandGrid(base, axes);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    const auto begin = std::chrono::steady_clock::now();
+    const std::vector<SweepResult> results = runSweep(points, threads);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::cerr << points.size() << " points in " << seconds << " s on " << std::min<std::size_t>(threads, points.size()) << " threads\n";
+
+    if (!csv_path.empty()) {
+        std::ofstream csv(csv_path);
+        writeCsv(csv, axes, points, results);
+    }
+    if (!json_path.empty()) {
+        std::ofstream json(json_path);
+        writeJson(json, axes, points, results);
+    }
+    if (csv_path.empty() && json_path.empty()) writeCsv(std::cout, axes, points, results);
+    return EXIT_SUCCESS;
+}
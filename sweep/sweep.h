@@ -0,0 +1,228 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common.h"
+#include "../server/cell.h"
+#include "../server/scheduler_profiles.h"
+#include "../client/client_stats.h"
+#include "../client/ue_engine.h"
+
+// One swept parameter and its values, given as KEY=v1,v2,...
+struct SweepAxis {
+    std::string key;
+    std::vector<std::string> values;
+};
+
+inline SweepAxis parseAxis(const std::string& arg) {
+    const auto eq = arg.find('=');
+    if (eq == std::string::npos || eq == 0 || eq + 1 == arg.size()) throw std::invalid_argument("expected KEY=v1,v2,... instead of " + arg);
+    SweepAxis axis{arg.substr(0, eq), {}};
+    for (std::size_t begin = eq + 1; begin <= arg.size(); ) {
+        const std::size_t end = std::min(arg.find(',', begin), arg.size());
+        if (end > begin) axis.values.push_back(arg.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return axis;
+}
+
+struct SweepPoint {
+    std::vector<std::string> values;    // one per axis
+    Configuration cfg;
+};
+
+// Cartesian product of the axes applied to base, the last axis varies fastest
+inline std::vector<SweepPoint> expandGrid(const Configuration& base, const std::vector<SweepAxis>& axes) {
+    std::vector<SweepPoint> points{{{}, base}};
+    for (const auto& axis : axes) {
+        std::vector<SweepPoint> expanded;
+        for (const auto& point : points) {
+            for (const auto& value : axis.values) {
+                SweepPoint next = point;
+                if (!next.cfg.set(axis.key, value)) throw std::invalid_argument("unknown parameter " + axis.key);
+                next.values.push_back(value);
+                expanded.push_back(std::move(next));
+            }
+        }
+        points = std::move(expanded);
+    }
+    return points;
+}
+
+struct SweepResult {
+    double success_rate = 0;
+    double ul_throughput = 0;   // bytes/sec per cell, as reported by the client
+    double dl_throughput = 0;
+    double ul_utilization = 0;  // percent of the resource blocks, as reported by the server
+    double dl_utilization = 0;
+    double avg_delay = 0;
+    uint64_t p50_delay = 0;     // subframes between two successes of a UE, over all of them
+    uint64_t p95_delay = 0;
+    uint64_t p99_delay = 0;
+    uint64_t starved_delays = 0;    // longer than STARVATION_SF
+    double ul_fairness = 0;     // Jain's index of the blocks granted per UE
+    double dl_fairness = 0;
+};
+
+/* Transport of the sweep: the client's requests go straight into the cells'
+ * schedulers, split by cell and merged back in request order like UdpLink.
+ * The cells time their steps into metrics of their own, points running in
+ * parallel share nothing.
+ */
+template <typename Sched>
+class InMemoryLink {
+    const Configuration& cfg_;
+    std::vector<std::vector<ResourceRequest>> cell_requests_;
+    std::vector<std::vector<SchedulerResponse>> cell_responses_;
+    std::vector<unsigned> cell_responded_;
+    ServerMetrics metrics_{};
+
+  public:
+    std::vector<Cell<Sched>> cells{};
+
+    explicit InMemoryLink(const Configuration& cfg)
+      : cfg_(cfg), cell_requests_(cfg.CELLS), cell_responses_(cfg.CELLS, std::vector<SchedulerResponse>(cfg.M)), cell_responded_(cfg.CELLS) {
+        for (uint32_t id = 0; id < cfg.CELLS; id++) cells.emplace_back(cfg, id, metrics_);
+    }
+
+    void exchange(const std::vector<ResourceRequest>& requests, std::vector<SchedulerResponse>& responses) {
+        for (auto& batch : cell_requests_) batch.clear();
+        for (const auto& req : requests) cell_requests_[req.ue_id / cfg_.M].push_back(req);
+        for (uint32_t cell = 0; cell < cfg_.CELLS; cell++) {
+            const auto& batch = cell_requests_[cell];
+            cells[cell].schedule({batch.data(), batch.size()}, cell_responses_[cell].data());
+        }
+        std::fill(cell_responded_.begin(), cell_responded_.end(), 0);
+        responses.clear();
+        for (const auto& req : requests) {
+            const uint32_t cell = req.ue_id / cfg_.M;
+            responses.push_back(cell_responses_[cell][cell_responded_[cell]++]);
+        }
+    }
+};
+
+// One simulation run in virtual time on the calling thread
+template <typename Sched>
+SweepResult simulate(const Configuration& cfg) {
+    UeEngine engine(cfg, cfg.M * cfg.CELLS, 0);
+    InMemoryLink<Sched> link(cfg);
+    ClientStats stats(cfg);
+    std::vector<ResourceRequest> requests;
+    std::vector<SchedulerResponse> responses;
+    for (unsigned sf = 1; sf <= cfg.SIMULATION_PERIOD_SF; sf++) {
+        engine.collect(sf, requests);
+        link.exchange(requests, responses);
+        engine.deliver(sf, responses);
+        stats.update(sf, requests, responses);
+    }
+
+    SweepResult result;
+    result.success_rate = stats.successRate();
+    result.ul_throughput = stats.ulThroughput();
+    result.dl_throughput = stats.dlThroughput();
+    const DelaySummary delays = stats.delaySummary();
+    result.avg_delay = delays.avgDelay();
+    result.p50_delay = delays.delays.quantile(0.5);
+    result.p95_delay = delays.delays.quantile(0.95);
+    result.p99_delay = delays.delays.quantile(0.99);
+    result.starved_delays = delays.starved_delays;
+    std::vector<const UeTable*> ul_ue_tables;
+    std::vector<const UeTable*> dl_ue_tables;
+    for (auto& cell : link.cells) {
+        result.ul_utilization += 100.0 * cell.uplink.avgBlockPerSf(0, cfg.SIMULATION_PERIOD_SF - 1) / cfg.N / cfg.CELLS;
+        result.dl_utilization += 100.0 * cell.downlink.avgBlockPerSf(0, cfg.SIMULATION_PERIOD_SF - 1) / cfg.N / cfg.CELLS;
+        ul_ue_tables.push_back(&cell.ul_ue_table);
+        dl_ue_tables.push_back(&cell.dl_ue_table);
+    }
+    result.ul_fairness = jainFairness(ul_ue_tables);
+    result.dl_fairness = jainFairness(dl_ue_tables);
+    return result;
+}
+
+inline SweepResult simulatePoint(const Configuration& cfg) {
+    switch (cfg.SCHEDULER_ENGINE) {
+    case SchedulerEngine::INDEXED:
+        return simulate<IndexedScheduler>(cfg);
+    case SchedulerEngine::BITMAP:
+        return simulate<BitmapScheduler>(cfg);
+    case SchedulerEngine::LINEAR:
+        break;
+    }
+    SweepResult result;
+    withLinearScheduler(cfg, [&](auto sched) { result = simulate<typename decltype(sched)::type>(cfg); });
+    return result;
+}
+
+/* Runs every point on a pool of threads workers, each takes the next point
+ * not started yet. Points are independent simulations and share nothing.
+ */
+inline std::vector<SweepResult> runSweep(const std::vector<SweepPoint>& points, unsigned threads) {
+    std::vector<SweepResult> results(points.size());
+    std::atomic<std::size_t> next{0};
+    const auto work = [&]() {
+        for (std::size_t i = next++; i < points.size(); i = next++) results[i] = simulatePoint(points[i].cfg);
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < std::min<std::size_t>(std::max(threads, 1U), points.size()); t++) pool.emplace_back(work);
+    work();
+    for (auto& thread : pool) thread.join();
+    return results;
+}
+
+inline void writeCsv(std::ostream& os, const std::vector<SweepAxis>& axes, const std::vector<SweepPoint>& points,
+                     const std::vector<SweepResult>& results) {
+    for (const auto& axis : axes) os << axis.key << ",";
+    os << "success_rate,ul_throughput,dl_throughput,ul_utilization,dl_utilization,avg_delay,p50_delay,p95_delay,p99_delay,starved_delays,ul_fairness,dl_fairness\n";
+    for (std::size_t i = 0; i < points.size(); i++) {
+        for (const auto& value : points[i].values) os << value << ",";
+        const auto& r = results[i];
+        os << r.success_rate << "," << r.ul_throughput << "," << r.dl_throughput << ","
+           << r.ul_utilization << "," << r.dl_utilization << "," << r.avg_delay << ","
+           << r.p50_delay << "," << r.p95_delay << "," << r.p99_delay << "," << r.starved_delays << ","
+           << r.ul_fairness << "," << r.dl_fairness << "\n";
+    }
+}
+
+// JSON has no NaN or infinity, such ratios of a point without samples are null
+struct JsonNumber {
+    double value;
+};
+
+inline std::ostream& operator << (std::ostream& os, JsonNumber number) {
+    if (std::isfinite(number.value)) return os << number.value;
+    return os << "null";
+}
+
+// Array of objects, parameter values are kept as strings as they were given
+inline void writeJson(std::ostream& os, const std::vector<SweepAxis>& axes, const std::vector<SweepPoint>& points,
+                      const std::vector<SweepResult>& results) {
+    os << "[\n";
+    for (std::size_t i = 0; i < points.size(); i++) {
+        os << "  {";
+        for (std::size_t a = 0; a < axes.size(); a++) os << std::quoted(axes[a].key) << ": " << std::quoted(points[i].values[a]) << ", ";
+        const auto& r = results[i];
+        os << "\"success_rate\": " << JsonNumber{r.success_rate} << ", \"ul_throughput\": " << JsonNumber{r.ul_throughput}
+           << ", \"dl_throughput\": " << JsonNumber{r.dl_throughput} << ", \"ul_utilization\": " << JsonNumber{r.ul_utilization}
+           << ", \"dl_utilization\": " << JsonNumber{r.dl_utilization} << ", \"avg_delay\": " << JsonNumber{r.avg_delay}
+           << ", \"p50_delay\": " << r.p50_delay << ", \"p95_delay\": " << r.p95_delay
+           << ", \"p99_delay\": " << r.p99_delay << ", \"starved_delays\": " << r.starved_delays
+           << ", \"ul_fairness\": " << JsonNumber{r.ul_fairness} << ", \"dl_fairness\": " << JsonNumber{r.dl_fairness} << "}"
+           << (i + 1 < points.size() ? "," : "") << "\n";
+    }
+    os << "]\n";
+}
@@ -0,0 +1,186 @@
+/* Copyright (C) 2024 Maxim Plekh - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license.
+ *
+ * You should have received a copy of the GPLv3 license with this file.
+ * If not, please visit : http://choosealicense.com/licenses/gpl-3.0/
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+
+/* Binary request trace: a header, the ResourceRequests of every recorded
+ * batch back to back, then an index with one entry per batch. Records and
+ * index are used in place from a read-only mapping of the file.
+ */
+constexpr char TRACE_MAGIC[8] = {'E', 'N', 'B', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint32_t TRACE_VERSION = 1;
+constexpr uint32_t TRACE_MAX_CELLS = 1U << 16;     // bounds the per-cell state a corrupt header makes a replay allocate
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t cells;             // cell ids are below cells
+    uint64_t num_batches;
+    uint64_t num_records;
+    uint64_t index_offset;      // file offset of num_batches TraceBatch entries
+};
+
+// One cell's subframe batch
+struct TraceBatch {
+    uint64_t first_record;      // index of the batch's first record
+    uint32_t cell_id;
+    uint32_t subframe;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+/* Appends batches to a trace file. Records are streamed to the file as they
+ * come, the index is kept in memory and written by close(). record() may be
+ * called from several threads, batches of a cell must come in subframe order.
+ */
+class TraceWriter {
+    std::mutex mtx_{};
+    std::ofstream out_{};
+    std::vector<TraceBatch> index_{};
+    uint64_t num_records_ = 0;
+    uint32_t cells_ = 0;
+
+  public:
+    TraceWriter() = default;
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator = (const TraceWriter&) = delete;
+    ~TraceWriter() { close(); }
+
+    bool isOpen() const { return out_.is_open(); }
+
+    void open(const std::string& path) {
+        std::unique_lock guard(mtx_);
+        out_.open(path, std::ios::binary | std::ios::trunc);
+        if (!out_) throw std::system_error(errno, std::generic_category(), "cannot open trace " + path);
+        const TraceHeader placeholder{};
+        out_.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+        index_.clear();
+        num_records_ = 0;
+        cells_ = 0;
+    }
+
+    void record(uint32_t cell_id, uint32_t subframe, Span<const ResourceRequest> requests) {
+        std::unique_lock guard(mtx_);
+        index_.push_back({num_records_, cell_id, subframe, static_cast<uint32_t>(requests.size()), 0});
+        out_.write(reinterpret_cast<const char*>(requests.begin()), requests.size() * sizeof(ResourceRequest));
+        num_records_ += requests.size();
+        cells_ = std::max(cells_, cell_id + 1);
+    }
+
+    // Writes the index and the header, the trace is complete afterwards
+    void close() {
+        std::unique_lock guard(mtx_);
+        if (!out_.is_open()) return;
+        uint64_t index_offset = sizeof(TraceHeader) + num_records_ * sizeof(ResourceRequest);
+        const uint64_t padding = (alignof(TraceBatch) - index_offset % alignof(TraceBatch)) % alignof(TraceBatch);
+        const char zeros[alignof(TraceBatch)]{};
+        out_.write(zeros, padding);
+        index_offset += padding;
+        out_.write(reinterpret_cast<const char*>(index_.data()), index_.size() * sizeof(TraceBatch));
+
+        TraceHeader header{};
+        std::memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+        header.version = TRACE_VERSION;
+        header.cells = cells_;
+        header.num_batches = index_.size();
+        header.num_records = num_records_;
+        header.index_offset = index_offset;
+        out_.seekp(0);
+        out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out_.close();
+        if (out_.fail()) std::cerr << "trace was not written completely\n";
+    }
+};
+
+// Batches are recorded when TRACE_RECORD names a file, see main()
+inline TraceWriter trace_writer;
+
+// Read-only mapping of a complete trace file
+class TraceReader {
+    int fd_ = -1;
+    std::size_t size_ = 0;
+    void* map_ = nullptr;
+    const TraceHeader* header_ = nullptr;
+
+    void fail(const std::string& what) {
+        unmap();
+        throw std::runtime_error(what);
+    }
+
+    void unmap() {
+        if (map_) munmap(map_, size_);
+        if (fd_ >= 0) ::close(fd_);
+        map_ = nullptr;
+        fd_ = -1;
+    }
+
+  public:
+    explicit TraceReader(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "cannot open trace " + path);
+        struct stat st{};
+        if (fstat(fd_, &st) < 0) {
+            const int err = errno;
+            unmap();
+            throw std::system_error(err, std::generic_category(), "fstat");
+        }
+        size_ = st.st_size;
+        if (size_ < sizeof(TraceHeader)) fail(path + " is not a trace");
+        map_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (map_ == MAP_FAILED) {
+            map_ = nullptr;
+            fail("cannot map trace " + path);
+        }
+        header_ = static_cast<const TraceHeader*>(map_);
+        if (std::memcmp(header_->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) fail(path + " is not a trace");
+        if (header_->version != TRACE_VERSION) fail(path + " has unsupported trace version " + std::to_string(header_->version));
+        if (header_->num_records > (size_ - sizeof(TraceHeader)) / sizeof(ResourceRequest)
+            || header_->index_offset % alignof(TraceBatch) != 0 || header_->index_offset > size_
+            || sizeof(TraceHeader) + header_->num_records * sizeof(ResourceRequest) > header_->index_offset
+            || header_->num_batches > (size_ - header_->index_offset) / sizeof(TraceBatch)) {
+            fail(path + " is truncated");
+        }
+        if (header_->cells > TRACE_MAX_CELLS) fail(path + " has " + std::to_string(header_->cells) + " cells");
+        madvise(map_, size_, MADV_SEQUENTIAL);
+    }
+
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator = (const TraceReader&) = delete;
+    ~TraceReader() { unmap(); }
+
+    uint32_t cells() const { return header_->cells; }
+    uint64_t numRecords() const { return header_->num_records; }
+
+    Span<const TraceBatch> batches() const {
+        const auto* base = static_cast<const char*>(map_);
+        return {reinterpret_cast<const TraceBatch*>(base + header_->index_offset), header_->num_batches};
+    }
+
+    Span<const ResourceRequest> records(const TraceBatch& batch) const {
+        const auto* records = reinterpret_cast<const ResourceRequest*>(header_ + 1);
+        if (batch.first_record + batch.count > header_->num_records) throw std::runtime_error("trace batch out of bounds");
+        return {records + batch.first_record, batch.count};
+    }
+};